@@ -0,0 +1,126 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#include <stdio.h>
+
+#include "src/ack.h"
+
+
+/* Acknowledgement overhead benchmark. PACKETS full-sized packets arrive
+ * every SPACING nanoseconds and are fed to a `twist__ack` scheduler, which
+ * sends a standalone acknowledgement whenever one falls due. Every threshold
+ * is run with packets arriving in order, and with every REORDER'th pair of
+ * packets swapped. Results are reported as the total number of packets on
+ * the wire (data and acknowledgements) per KB of payload, along with the
+ * mean time acknowledgements were held back. */
+#define MSS      1400
+#define PACKETS  10000
+#define SPACING  112000
+#define REORDER  100
+
+
+/* Results of a single run. */
+struct result {
+    unsigned long acks;
+    double per_kb;
+    double mean_delay;
+};
+
+
+/* Static functions. */
+static void run(unsigned int threshold, int reorder, struct result * res);
+
+
+int main(int argc, char ** argv) {
+    static const unsigned int thresholds[] = { 1, ACK_DEFAULT_THRESHOLD, 8 };
+    struct result res;
+    size_t i;
+    int reorder;
+
+    (void) argc;
+    (void) argv;
+
+    printf("%d packets of %d bytes, %.1f us apart\n\n", PACKETS, MSS, SPACING / 1e3);
+    printf("%10s %10s %10s %14s %14s\n", "threshold", "order", "acks", "packets/KB", "mean delay us");
+
+    for (reorder = 0; reorder <= 1; reorder++) {
+        for (i = 0; i < sizeof(thresholds) / sizeof(thresholds[0]); i++) {
+            run(thresholds[i], reorder, &res);
+
+            printf("%10u %10s %10lu %14.2f %14.1f\n", thresholds[i],
+                   (reorder ? "reordered" : "in order"), res.acks, res.per_kb,
+                   res.mean_delay / 1e3);
+        }
+    }
+
+    return 0;
+}
+
+
+/* Feed PACKETS packets to a scheduler acknowledging every `threshold`
+ * packets, optionally swapping every REORDER'th pair. */
+static void run(unsigned int threshold, int reorder, struct result * res) {
+    struct twist__range ranges[ACK_MAX_RANGES];
+    struct twist__ack ack;
+    int64_t now, deadline, delay, sum;
+    uint64_t number;
+    unsigned long acks;
+    long n;
+
+    twist__ack_init(&ack, threshold, ACK_DEFAULT_DELAY);
+
+    acks = 0;
+    sum = 0;
+
+    for (n = 0; n < PACKETS; n++) {
+        now = (int64_t) (n + 1) * SPACING;
+
+        /* An acknowledgement whose delay expired before this packet arrived
+         * went out on its own. */
+        deadline = twist__ack_deadline(&ack);
+        if (deadline != 0 && deadline < now) {
+            twist__ack_build(&ack, ranges, ACK_MAX_RANGES, &delay, deadline);
+            sum += delay;
+            acks++;
+        }
+
+        number = (uint64_t) n;
+        if (reorder && n % REORDER == REORDER - 2)
+            number++;
+        else if (reorder && n % REORDER == REORDER - 1)
+            number--;
+
+        twist__ack_recv(&ack, number, now);
+
+        deadline = twist__ack_deadline(&ack);
+        if (deadline != 0 && deadline <= now) {
+            twist__ack_build(&ack, ranges, ACK_MAX_RANGES, &delay, now);
+            sum += delay;
+            acks++;
+        }
+    }
+
+    /* Flush the last acknowledgement, if one is still pending. */
+    deadline = twist__ack_deadline(&ack);
+    if (deadline != 0) {
+        twist__ack_build(&ack, ranges, ACK_MAX_RANGES, &delay, deadline);
+        sum += delay;
+        acks++;
+    }
+
+    res->acks = acks;
+    res->per_kb = (double) (PACKETS + acks) / ((double) PACKETS * MSS / 1000);
+    res->mean_delay = (acks > 0 ? (double) sum / (double) acks : 0);
+}
@@ -0,0 +1,188 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "src/cc.h"
+#include "src/pacer.h"
+
+
+/* Simulated link benchmark for the congestion controllers. A single bulk
+ * flow, paced at its controller's pacing rate, sends full-sized segments over
+ * a bottleneck link with a drop-tail queue. Every segment is acknowledged
+ * individually one round trip after leaving the queue; a dropped segment is
+ * reported as lost at the time its acknowledgement would have arrived. The
+ * first WARMUP nanoseconds of every run are excluded from the results, which
+ * report goodput, the mean and maximum time segments spent queued, and the
+ * fraction of segments dropped. */
+#define MSS       1400
+#define RATE      10000000
+#define DELAY     20000000
+#define WARMUP    ((int64_t) 10000000000)
+#define DURATION  ((int64_t) 60000000000)
+
+/* Maximum number of segments in flight. */
+#define MAX_EVENTS  (1 << 20)
+
+
+/* Fate of a segment, as it will be learned by the sender. */
+struct event {
+    /* Time the sender learns about the segment, and the time it was sent. */
+    int64_t time;
+    int64_t sent;
+
+    /* Time spent in the bottleneck queue, or -1 if the segment was dropped. */
+    int64_t queued;
+};
+
+
+/* Results of a single run. */
+struct result {
+    double goodput;
+    double mean_queue;
+    double max_queue;
+    double loss;
+};
+
+
+/* Static functions. */
+static void run(int type, size_t queue, struct result * res);
+
+
+int main(int argc, char ** argv) {
+    static const int types[] = { TWIST_CC_RENO, TWIST_CC_CUBIC, TWIST_CC_BBR };
+    static const char * names[] = { "reno", "cubic", "bbr" };
+    static const size_t queues[] = { 500000, 50000 };
+    struct result res;
+    size_t i, j;
+
+    (void) argc;
+    (void) argv;
+
+    printf("link: %.1f MB/s, %d ms RTT\n\n", RATE / 1e6, 2 * DELAY / 1000000);
+    printf("%8s %10s %12s %14s %14s %10s\n", "cc", "queue", "goodput MB/s",
+           "mean queue ms", "max queue ms", "loss %");
+
+    for (i = 0; i < sizeof(queues) / sizeof(queues[0]); i++) {
+        for (j = 0; j < sizeof(types) / sizeof(types[0]); j++) {
+            run(types[j], queues[i], &res);
+
+            printf("%8s %10lu %12.2f %14.1f %14.1f %10.3f\n", names[j], (unsigned long) queues[i],
+                   res.goodput / 1e6, res.mean_queue / 1e6, res.max_queue / 1e6, res.loss * 100);
+        }
+    }
+
+    return 0;
+}
+
+
+/* Simulate a flow using congestion control algorithm `type` over the link,
+ * with a queue of `queue` bytes in front of it. */
+static void run(int type, size_t queue, struct result * res) {
+    static struct event events[MAX_EVENTS];
+    struct twist__pacer pacer;
+    struct twist__cc cc;
+    struct event * ev;
+    size_t head, tail, inflight;
+    int64_t now, next, release, link, backlog, queued, sum, max;
+    uint64_t rate, sent, dropped, delivered;
+
+    now = 1;
+
+    twist__cc_init(&cc, type, MSS, now);
+    twist__pacer_init(&pacer, PACER_DEFAULT_BURST, now);
+
+    head = tail = 0;
+    inflight = 0;
+    link = 0;
+
+    sent = dropped = delivered = 0;
+    sum = max = 0;
+
+    while (now < WARMUP + DURATION) {
+        /* Deliver everything the sender has learned by now. */
+        while (head != tail && events[head % MAX_EVENTS].time <= now) {
+            ev = &events[head++ % MAX_EVENTS];
+            inflight -= MSS;
+
+            if (ev->queued < 0) {
+                twist__cc_on_loss(&cc, ev->sent, inflight, now);
+                continue;
+            }
+
+            twist__cc_on_rtt_sample(&cc, now - ev->sent, now);
+            twist__cc_on_ack(&cc, MSS, inflight, now);
+
+            if (ev->sent >= WARMUP) {
+                delivered++;
+                sum += ev->queued;
+                if (ev->queued > max)
+                    max = ev->queued;
+            }
+        }
+
+        /* Send as much as the window and the pacer allow. */
+        rate = twist__cc_pacing_rate(&cc);
+
+        while (twist__cc_can_send(&cc, inflight) && twist__pacer_can_send(&pacer, rate, MSS, now)) {
+            if (tail - head == MAX_EVENTS) {
+                fprintf(stderr, "too many segments in flight\n");
+                exit(1);
+            }
+
+            ev = &events[tail++ % MAX_EVENTS];
+            ev->sent = now;
+
+            /* The segment is dropped if the queue is full. */
+            queued = (link > now ? link - now : 0);
+            backlog = queued * RATE / 1000000000;
+
+            if ((size_t) backlog + MSS > queue) {
+                ev->time = now + queued + 2 * DELAY;
+                ev->queued = -1;
+            } else {
+                link = now + queued + (int64_t) MSS * 1000000000 / RATE;
+                ev->time = link + 2 * DELAY;
+                ev->queued = queued;
+            }
+
+            if (now >= WARMUP) {
+                sent++;
+                dropped += (ev->queued < 0);
+            }
+
+            inflight += MSS;
+            twist__pacer_sent(&pacer, MSS);
+        }
+
+        /* Move on to the next event: an acknowledgement, or the pacer
+         * releasing another segment. */
+        next = (head != tail ? events[head % MAX_EVENTS].time : WARMUP + DURATION);
+
+        if (twist__cc_can_send(&cc, inflight)) {
+            release = twist__pacer_next(&pacer, rate, MSS, now);
+            if (release < next)
+                next = release;
+        }
+
+        now = (next > now ? next : now + 1);
+    }
+
+    res->goodput = (double) delivered * MSS / ((double) DURATION / 1e9);
+    res->mean_queue = (delivered > 0 ? (double) sum / (double) delivered : 0);
+    res->max_queue = (double) max;
+    res->loss = (sent > 0 ? (double) dropped / (double) sent : 0);
+}
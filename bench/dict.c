@@ -0,0 +1,157 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "src/conn.h"
+#include "src/dict.h"
+#include "src/mem.h"
+
+
+/* `twist__dict_find` benchmark. The dict is filled with connections whose
+ * cookies are random 64-bit values, like the ones handed out by a socket's
+ * PRNG, and then looked up in random order, both with cookies that are
+ * present (hits) and cookies that aren't (misses). Every size is run with
+ * both TWIST_HASH_FAST and TWIST_HASH_SIPHASH. */
+#define LOOKUPS  10000000
+
+
+/* Static functions. */
+static void run(int hash, struct twist__conn * conns, size_t count,
+                double * hit, double * miss);
+static uint64_t rnd(void);
+
+
+/* State of the xorshift generator behind `rnd`. */
+static uint64_t seed;
+
+
+int main(int argc, char ** argv) {
+    static const size_t counts[] = { 10000, 100000, 1000000 };
+    static const int hashes[] = { TWIST_HASH_FAST, TWIST_HASH_SIPHASH };
+    struct twist__conn * conns;
+    double hit, miss;
+    size_t i, j;
+
+    (void) argc;
+    (void) argv;
+
+    printf("%10s %8s %12s %12s %12s\n", "conns", "hash", "lookups", "hit ns", "miss ns");
+
+    for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        conns = calloc(counts[i], sizeof(*conns));
+        if (conns == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        for (j = 0; j < sizeof(hashes) / sizeof(hashes[0]); j++) {
+            run(hashes[j], conns, counts[i], &hit, &miss);
+
+            printf("%10lu %8s %12lu %12.1f %12.1f\n", (unsigned long) counts[i],
+                   (hashes[j] == TWIST_HASH_FAST ? "fast" : "siphash"), (unsigned long) LOOKUPS,
+                   hit * 1e9 / LOOKUPS, miss * 1e9 / LOOKUPS);
+        }
+
+        free(conns);
+    }
+
+    return 0;
+}
+
+
+/* Fill a dict using hash function `hash` with `count` connections, and time
+ * LOOKUPS successful and unsuccessful lookups, storing the elapsed CPU time
+ * of each in seconds. */
+static void run(int hash, struct twist__conn * conns, size_t count,
+                double * hit, double * miss) {
+    static uint8_t key[16] = "twist bench key";
+    struct twist__dict dict;
+    struct twist__mem mem;
+    uint64_t * cookies;
+    clock_t start;
+    uint64_t found;
+    size_t i;
+    long n;
+
+    twist__mem_init(&mem, NULL, 0);
+    if (twist__dict_init(&dict, key, hash, &mem) != TWIST_OK) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    /* Cookies are looked up from a separate array, so that picking one
+     * doesn't cost a cache miss on a connection struct. */
+    cookies = malloc(count * sizeof(uint64_t));
+    if (cookies == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    seed = 88172645463325252ULL;
+
+    for (i = 0; i < count; i++) {
+        conns[i].local_cookie = rnd();
+        cookies[i] = conns[i].local_cookie;
+
+        if (twist__dict_add(&dict, &conns[i]) != TWIST_OK) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    /* Lookups move entries along while the dict is being resized, so finish
+     * any resize that's still in progress before measuring. */
+    for (i = 0; i < count; i++)
+        twist__dict_find(&dict, cookies[i]);
+
+    found = 0;
+    start = clock();
+
+    for (n = 0; n < LOOKUPS; n++)
+        found += (twist__dict_find(&dict, cookies[rnd() % count]) != NULL);
+
+    *hit = (double) (clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+
+    /* Random cookies practically never collide with the stored ones. */
+    for (n = 0; n < LOOKUPS; n++)
+        found += (twist__dict_find(&dict, rnd()) != NULL);
+
+    *miss = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    if (found != LOOKUPS) {
+        fprintf(stderr, "unexpected lookup results\n");
+        exit(1);
+    }
+
+    for (i = 0; i < count; i++)
+        twist__dict_remove(&dict, &conns[i]);
+
+    twist__dict_clear(&dict);
+    free(cookies);
+}
+
+
+/* Xorshift generator, so runs are repeatable across platforms. */
+static uint64_t rnd(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+
+    return seed;
+}
@@ -0,0 +1,272 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "src/conn.h"
+#include "src/heap.h"
+#include "src/mem.h"
+
+
+/* `twist__heap_fix` throughput benchmark. The heap is filled with connections
+ * whose timers are spread over the next 30 seconds, and then one of two kinds
+ * of rescheduling is measured:
+ *
+ *   - random: a random connection receives a packet and moves its timer to a
+ *     random point in the same range, which mostly sifts entries up;
+ *   - top: the connection with the earliest timer expires and is rescheduled
+ *     to a later time, which sifts the root all the way down, as `twist_tick`
+ *     does.
+ *
+ * Both are also run against the binary heap of connection pointers that
+ * `twist__heap` replaced, which compares `next_tick` values by reaching into
+ * the connection structs. A minimal copy of it is kept below. */
+#define SPAN   30000000000
+#define FIXES  5000000
+
+
+/* Binary heap of connection pointers, as `twist__heap` used to be. */
+struct binary_heap {
+    struct twist__conn ** entries;
+    uint32_t count;
+};
+
+
+/* Static functions. */
+static double run(struct twist__conn * conns, size_t count, int top, int binary);
+static uint64_t rnd(void);
+
+static void binary_add(struct binary_heap * heap, struct twist__conn * conn);
+static void binary_fix(struct binary_heap * heap, struct twist__conn * conn);
+static void binary_up(struct binary_heap * heap, uint32_t index);
+static void binary_down(struct binary_heap * heap, uint32_t index);
+static int binary_less(struct binary_heap * heap, uint32_t i, uint32_t j);
+static void binary_swap(struct binary_heap * heap, uint32_t i, uint32_t j);
+
+
+/* State of the xorshift generator behind `rnd`. */
+static uint64_t seed;
+
+
+int main(int argc, char ** argv) {
+    static const size_t counts[] = { 10000, 100000, 1000000 };
+    struct twist__conn * conns;
+    double spread, top;
+    size_t i;
+    int binary;
+
+    (void) argc;
+    (void) argv;
+
+    printf("%10s %8s %12s %16s %16s\n", "conns", "layout", "fixes", "random ns/fix", "top ns/fix");
+
+    for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        conns = calloc(counts[i], sizeof(*conns));
+        if (conns == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        for (binary = 1; binary >= 0; binary--) {
+            spread = run(conns, counts[i], 0, binary);
+            top = run(conns, counts[i], 1, binary);
+
+            printf("%10lu %8s %12lu %16.1f %16.1f\n", (unsigned long) counts[i],
+                   (binary ? "binary" : "4-ary"), (unsigned long) FIXES,
+                   spread * 1e9 / FIXES, top * 1e9 / FIXES);
+        }
+
+        free(conns);
+    }
+
+    return 0;
+}
+
+
+/* Fill a heap with `count` connections and time FIXES reschedulings, either
+ * of random connections or of the top-most one, using either `twist__heap`
+ * or the old binary layout. Returns the elapsed CPU time in seconds, not
+ * counting the heap's construction. */
+static double run(struct twist__conn * conns, size_t count, int top, int binary) {
+    struct binary_heap old;
+    struct twist__heap heap;
+    struct twist__conn * conn;
+    struct twist__mem mem;
+    clock_t start;
+    int64_t now;
+    size_t i;
+    long n;
+
+    twist__mem_init(&mem, NULL, 0);
+    if (twist__heap_init(&heap, &mem) != TWIST_OK) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    old.entries = malloc(count * sizeof(struct twist__conn *));
+    old.count = 0;
+    if (old.entries == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    seed = 88172645463325252ULL;
+
+    for (i = 0; i < count; i++) {
+        conns[i].local_cookie = i + 1;
+        conns[i].next_tick = 1 + (int64_t) (rnd() % SPAN);
+
+        if (binary) {
+            binary_add(&old, &conns[i]);
+        } else if (twist__heap_add(&heap, &conns[i]) != TWIST_OK) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    now = 0;
+    start = clock();
+
+    for (n = 0; n < FIXES; n++) {
+        if (top) {
+            conn = (binary ? old.entries[0] : twist__heap_peek(&heap));
+            now = conn->next_tick;
+            conn->next_tick = now + 1 + (int64_t) (rnd() % SPAN);
+        } else {
+            conn = &conns[rnd() % count];
+            conn->next_tick = 1 + (int64_t) (rnd() % SPAN);
+        }
+
+        if (binary)
+            binary_fix(&old, conn);
+        else
+            twist__heap_fix(&heap, conn);
+    }
+
+    start = clock() - start;
+
+    if (!binary)
+        for (i = 0; i < count; i++)
+            twist__heap_remove(&heap, &conns[i]);
+
+    twist__heap_clear(&heap);
+    free(old.entries);
+
+    return (double) start / CLOCKS_PER_SEC;
+}
+
+
+/* Xorshift generator, so runs are repeatable across platforms. */
+static uint64_t rnd(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+
+    return seed;
+}
+
+
+/* Push a connection onto the binary heap, which has room for it. */
+static void binary_add(struct binary_heap * heap, struct twist__conn * conn) {
+    conn->heap_index = heap->count;
+    heap->entries[heap->count++] = conn;
+
+    binary_up(heap, conn->heap_index);
+}
+
+
+/* Restore ordering after a connection's `next_tick` value has changed. */
+static void binary_fix(struct binary_heap * heap, struct twist__conn * conn) {
+    uint32_t index;
+
+    index = conn->heap_index;
+
+    binary_down(heap, index);
+    binary_up(heap, index);
+}
+
+
+/* Swap the entry at `index` with its parent until it's in order. */
+static void binary_up(struct binary_heap * heap, uint32_t index) {
+    uint32_t parent;
+
+    while (index != 0) {
+        parent = (index - 1) / 2;
+        if (binary_less(heap, parent, index))
+            break;
+
+        binary_swap(heap, index, parent);
+        index = parent;
+    }
+}
+
+
+/* Swap the entry at `index` with the lesser of its children until it's in
+ * order. */
+static void binary_down(struct binary_heap * heap, uint32_t index) {
+    uint32_t left, right, child;
+
+    for (;;) {
+        left = 2 * index + 1;
+        right = left + 1;
+
+        if (left >= heap->count)
+            break;
+
+        if (right >= heap->count || binary_less(heap, left, right))
+            child = left;
+        else
+            child = right;
+
+        if (binary_less(heap, index, child))
+            break;
+
+        binary_swap(heap, child, index);
+        index = child;
+    }
+}
+
+
+/* Returns a non-zero value if the entry at index `i` should be put in front
+ * of the entry at index `j`. Every `next_tick` in this benchmark is
+ * positive. */
+static int binary_less(struct binary_heap * heap, uint32_t i, uint32_t j) {
+    struct twist__conn * x, * y;
+
+    x = heap->entries[i];
+    y = heap->entries[j];
+
+    if (x->next_tick != y->next_tick)
+        return (x->next_tick < y->next_tick);
+
+    return (x->local_cookie < y->local_cookie);
+}
+
+
+/* Swap two entries, updating the connections' `heap_index` fields. */
+static void binary_swap(struct binary_heap * heap, uint32_t i, uint32_t j) {
+    struct twist__conn * x, * y;
+
+    x = heap->entries[i];
+    y = heap->entries[j];
+
+    heap->entries[i] = y;
+    heap->entries[j] = x;
+
+    x->heap_index = j;
+    y->heap_index = i;
+}
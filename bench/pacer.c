@@ -0,0 +1,223 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "src/cc.h"
+#include "src/pacer.h"
+
+
+/* Loss rate benchmark for bursty and paced sends. An application writes
+ * WRITE bytes every PERIOD nanoseconds, which averages to half the capacity
+ * of a bottleneck switch port with a shallow BUFFER byte queue. The sender's
+ * NIC is ten times faster than the bottleneck, so unpaced writes arrive at
+ * the switch as line-rate bursts.
+ *
+ * Paced runs release the same packets through a `twist__pacer`, either at a
+ * fixed rate, or at `twist__cc_pacing_rate` of a congestion controller whose
+ * window also gates the sender. Controllers see every packet acknowledged
+ * one round trip of 2 * DELAY nanoseconds after leaving the queue, and every
+ * dropped packet reported as lost at the time its acknowledgement would have
+ * arrived. */
+#define MSS      1400
+#define LINE     1250000000
+#define RATE     125000000
+#define BUFFER   65536
+#define DELAY    500000
+#define WRITE    (MSS * 180)
+#define PERIOD   4000000
+#define WRITES   10000
+
+/* Maximum number of packets in flight. */
+#define MAX_EVENTS  (1 << 16)
+
+/* Marks a configuration without a congestion controller. */
+#define NO_CC  -1
+
+
+/* Fate of a packet, as it will be learned by the sender. */
+struct event {
+    /* Time the sender learns about the packet, and the time it was sent. */
+    int64_t time;
+    int64_t sent;
+
+    /* Non-zero if the packet was dropped. */
+    int lost;
+};
+
+
+/* Results of a single run. */
+struct result {
+    double loss;
+    double max_queue;
+};
+
+
+/* Static functions. */
+static void run(int type, uint64_t rate, size_t burst, struct result * res);
+
+
+int main(int argc, char ** argv) {
+    static const struct {
+        const char * name;
+        int type;
+        uint64_t rate;
+        size_t burst;
+    } configs[] = {
+        { "none", NO_CC, 0, 0 },
+        { "100 MB/s", NO_CC, 100000000, 131072 },
+        { "100 MB/s", NO_CC, 100000000, 65536 },
+        { "100 MB/s", NO_CC, 100000000, PACER_DEFAULT_BURST },
+        { "80 MB/s", NO_CC, 80000000, PACER_DEFAULT_BURST },
+        { "80 MB/s", NO_CC, 80000000, 4 * MSS },
+        { "cubic", TWIST_CC_CUBIC, 0, PACER_DEFAULT_BURST },
+        { "bbr", TWIST_CC_BBR, 0, PACER_DEFAULT_BURST },
+    };
+    struct result res;
+    size_t i;
+
+    (void) argc;
+    (void) argv;
+
+    printf("bottleneck: %.0f MB/s, %d byte buffer; offered load: %.0f MB/s in %d byte writes\n\n",
+           RATE / 1e6, BUFFER, (double) WRITE / PERIOD * 1e3, WRITE);
+    printf("%10s %10s %10s %14s\n", "pacing", "burst", "loss %", "max queue us");
+
+    for (i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        run(configs[i].type, configs[i].rate, configs[i].burst, &res);
+
+        if (configs[i].type == NO_CC && configs[i].rate == 0)
+            printf("%10s %10s", configs[i].name, "-");
+        else
+            printf("%10s %10lu", configs[i].name, (unsigned long) configs[i].burst);
+
+        printf(" %10.3f %14.1f\n", res.loss * 100, res.max_queue / 1e3);
+    }
+
+    return 0;
+}
+
+
+/* Push every write through the sender's NIC and the bottleneck. Packets are
+ * paced by congestion control algorithm `type`, or if that's NO_CC, at a
+ * fixed `rate` bytes per second (or not at all if `rate` is 0), with a
+ * `burst` byte allowance. */
+static void run(int type, uint64_t rate, size_t burst, struct result * res) {
+    static struct event events[MAX_EVENTS];
+    struct twist__pacer pacer;
+    struct twist__cc cc;
+    struct event * ev;
+    size_t head, tail, inflight;
+    int64_t now, next, release, nic, link, queued, max;
+    unsigned long sent, dropped;
+    int write, n;
+
+    if (type != NO_CC)
+        twist__cc_init(&cc, type, MSS, 0);
+
+    twist__pacer_init(&pacer, burst, 0);
+
+    head = tail = 0;
+    inflight = 0;
+    nic = 0;
+    link = 0;
+    max = 0;
+    sent = dropped = 0;
+
+    for (write = 0; write < WRITES; write++) {
+        for (n = 0; n < WRITE / MSS; n++) {
+            /* A packet can't leave before it's written, or before the NIC is
+             * done with the previous one. */
+            now = (int64_t) write * PERIOD;
+            if (nic > now)
+                now = nic;
+
+            for (;;) {
+                /* Deliver everything the sender has learned by now. */
+                while (type != NO_CC && head != tail && events[head % MAX_EVENTS].time <= now) {
+                    ev = &events[head++ % MAX_EVENTS];
+                    inflight -= MSS;
+
+                    if (ev->lost) {
+                        twist__cc_on_loss(&cc, ev->sent, inflight, now);
+                    } else {
+                        twist__cc_on_rtt_sample(&cc, now - ev->sent, now);
+                        twist__cc_on_ack(&cc, MSS, inflight, now);
+                    }
+                }
+
+                /* The next event is an acknowledgement if the window is
+                 * full, otherwise the pacer releasing the packet (unless an
+                 * acknowledgement changes the pacing rate first). */
+                next = (head != tail ? events[head % MAX_EVENTS].time : now);
+
+                if (type != NO_CC) {
+                    if (!twist__cc_can_send(&cc, inflight)) {
+                        now = next;
+                        continue;
+                    }
+
+                    rate = twist__cc_pacing_rate(&cc);
+                }
+
+                if (twist__pacer_can_send(&pacer, rate, MSS, now))
+                    break;
+
+                release = twist__pacer_next(&pacer, rate, MSS, now);
+                now = (head != tail && next < release ? next : release);
+            }
+
+            twist__pacer_sent(&pacer, MSS);
+            nic = now + (int64_t) MSS * 1000000000 / LINE;
+
+            if (tail - head == MAX_EVENTS) {
+                fprintf(stderr, "too many packets in flight\n");
+                exit(1);
+            }
+
+            ev = &events[tail % MAX_EVENTS];
+            ev->sent = now;
+
+            /* The packet reaches the switch once it has been serialized, and
+             * is dropped if the port's queue is full. */
+            queued = (link > nic ? link - nic : 0);
+            sent++;
+
+            if (queued * RATE / 1000000000 + MSS > BUFFER) {
+                ev->time = nic + queued + 2 * DELAY;
+                ev->lost = 1;
+                dropped++;
+            } else {
+                link = nic + queued + (int64_t) MSS * 1000000000 / RATE;
+                ev->time = link + 2 * DELAY;
+                ev->lost = 0;
+
+                if (queued > max)
+                    max = queued;
+            }
+
+            /* Without a controller, nobody is listening for the packet's
+             * fate. */
+            if (type != NO_CC) {
+                tail++;
+                inflight += MSS;
+            }
+        }
+    }
+
+    res->loss = (double) dropped / (double) sent;
+    res->max_queue = (double) max;
+}
@@ -0,0 +1,227 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "src/mem.h"
+#include "src/packet.h"
+#include "src/pool.h"
+
+
+/* Object pool benchmarks. The fast path is measured by allocating and freeing
+ * objects of each size class, both one at a time (always hitting the most
+ * recently freed object) and in batches, as a socket operation that queues a
+ * burst of packets would. The memory footprint of small control packets and
+ * full-sized data packets is reported as the pool bytes in use per packet.
+ * Finally, bursts of traffic separated by lulls are simulated by allocating
+ * and freeing BURST datagram-sized objects, culling the pool down to a few
+ * spare objects after every burst, and counting the calls that reach the
+ * underlying allocator. */
+#define ROUNDS   10000000
+#define BATCH    64
+#define PACKETS  10000
+#define BURST    4096
+#define BURSTS   1000
+
+
+/* Static functions. */
+static void fast_path(void);
+static void footprint(void);
+static void churn(void);
+static double seconds(clock_t start);
+
+static void * counted_alloc(size_t size, void * priv);
+static void * counted_resize(void * ptr, size_t old_size, size_t size, void * priv);
+static void counted_release(void * ptr, size_t size, void * priv);
+
+
+int main(int argc, char ** argv) {
+    (void) argc;
+    (void) argv;
+
+    fast_path();
+    printf("\n");
+    footprint();
+    printf("\n");
+    churn();
+
+    return 0;
+}
+
+
+/* Time allocations and frees of every size class. */
+static void fast_path(void) {
+    static const size_t sizes[] = { POOL_SMALL_SIZE, POOL_OBJECT_SIZE, POOL_LARGE_SIZE, POOL_HUGE_SIZE };
+    static void * objs[BATCH];
+    struct twist__pool pool;
+    struct twist__mem mem;
+    double single, batch;
+    clock_t start;
+    size_t i;
+    long n;
+    int j;
+
+    printf("%10s %16s %16s\n", "size", "single ns/pair", "batch ns/pair");
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        twist__mem_init(&mem, NULL, 0);
+        twist__pool_init(&pool, &mem);
+
+        start = clock();
+
+        for (n = 0; n < ROUNDS; n++) {
+            objs[0] = twist__pool_alloc(&pool, sizes[i]);
+            if (objs[0] == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+
+            twist__pool_free(&pool, objs[0]);
+        }
+
+        single = seconds(start);
+        start = clock();
+
+        for (n = 0; n < ROUNDS / BATCH; n++) {
+            for (j = 0; j < BATCH; j++) {
+                objs[j] = twist__pool_alloc(&pool, sizes[i]);
+                if (objs[j] == NULL) {
+                    fprintf(stderr, "out of memory\n");
+                    exit(1);
+                }
+            }
+
+            for (j = 0; j < BATCH; j++)
+                twist__pool_free(&pool, objs[j]);
+        }
+
+        batch = seconds(start);
+
+        twist__pool_clear(&pool);
+
+        printf("%10lu %16.1f %16.1f\n", (unsigned long) sizes[i],
+               single * 1e9 / ROUNDS, batch * 1e9 / (ROUNDS / BATCH * BATCH));
+    }
+}
+
+
+/* Report the pool memory taken up by packets of typical sizes. */
+static void footprint(void) {
+    static const size_t lens[] = { 32, 176, 1200 };
+    static struct twist__packet * pkts[PACKETS];
+    struct twist__pool pool;
+    struct twist__mem mem;
+    size_t i;
+    int j;
+
+    printf("%10s %16s %16s\n", "payload", "bytes/packet", "reserved/packet");
+
+    for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        twist__mem_init(&mem, NULL, 0);
+        twist__pool_init(&pool, &mem);
+
+        for (j = 0; j < PACKETS; j++) {
+            pkts[j] = twist__packet_alloc(&pool, lens[i]);
+            if (pkts[j] == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+
+        printf("%10lu %16.1f %16.1f\n", (unsigned long) lens[i],
+               (double) twist__pool_used(&pool) / PACKETS,
+               (double) twist__pool_reserved(&pool) / PACKETS);
+
+        for (j = 0; j < PACKETS; j++)
+            twist__packet_free(&pool, pkts[j]);
+
+        twist__pool_clear(&pool);
+    }
+}
+
+
+/* Time bursts of allocations followed by a cull, and count how many of them
+ * had to go to the underlying allocator. */
+static void churn(void) {
+    static void * objs[BURST];
+    struct twist_allocator allocator;
+    struct twist__pool pool;
+    struct twist__mem mem;
+    unsigned long calls;
+    clock_t start;
+    double secs;
+    int i, j;
+
+    allocator.alloc = counted_alloc;
+    allocator.resize = counted_resize;
+    allocator.release = counted_release;
+    allocator.priv = &calls;
+
+    twist__mem_init(&mem, &allocator, 0);
+    twist__pool_init(&pool, &mem);
+
+    calls = 0;
+    start = clock();
+
+    for (i = 0; i < BURSTS; i++) {
+        for (j = 0; j < BURST; j++) {
+            objs[j] = twist__pool_alloc(&pool, POOL_OBJECT_SIZE);
+            if (objs[j] == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+
+        for (j = 0; j < BURST; j++)
+            twist__pool_free(&pool, objs[j]);
+
+        twist__pool_cull(&pool, 8);
+    }
+
+    secs = seconds(start);
+
+    twist__pool_clear(&pool);
+
+    printf("%10s %16s %16s\n", "burst", "ns/object", "allocator calls");
+    printf("%10d %16.1f %16.2f\n", BURST, secs * 1e9 / ((double) BURSTS * BURST),
+           (double) calls / BURSTS);
+}
+
+
+/* Allocator which counts the number of calls made to it. */
+static void * counted_alloc(size_t size, void * priv) {
+    (*(unsigned long *) priv)++;
+    return malloc(size);
+}
+
+static void * counted_resize(void * ptr, size_t old_size, size_t size, void * priv) {
+    (void) old_size;
+    (*(unsigned long *) priv)++;
+    return realloc(ptr, size);
+}
+
+static void counted_release(void * ptr, size_t size, void * priv) {
+    (void) size;
+    (*(unsigned long *) priv)++;
+    free(ptr);
+}
+
+
+/* Get the CPU time elapsed since `start`, in seconds. */
+static double seconds(clock_t start) {
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
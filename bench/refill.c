@@ -0,0 +1,105 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "src/pacer.h"
+
+
+/* Check of the pacer's refill arithmetic. For each rate, a pacer with the
+ * default burst allowance releases packets as fast as it allows for SECONDS
+ * seconds. The packets let through up front must be as many as fit in the
+ * bucket, and the rate held after that must match the configured one to
+ * within a byte per second, including at rates that don't divide evenly into
+ * nanoseconds. Exits with a non-zero status if either check fails. */
+#define MSS      1400
+#define SECONDS  10
+
+
+/* Static functions. */
+static int check(uint64_t rate);
+
+
+int main(int argc, char ** argv) {
+    static const uint64_t rates[] = { 1000, 1000000, 3333333, 125000000 };
+    size_t i;
+    int failed;
+
+    (void) argc;
+    (void) argv;
+
+    printf("%12s %10s %16s %16s\n", "rate B/s", "burst", "initial packets", "measured B/s");
+
+    failed = 0;
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+        failed |= check(rates[i]);
+
+    return (failed ? 1 : 0);
+}
+
+
+/* Release packets as fast as a pacer at `rate` bytes per second allows, and
+ * compare the result to what it should be. Returns a non-zero value if it
+ * doesn't match. */
+static int check(uint64_t rate) {
+    struct twist__pacer pacer;
+    unsigned long initial, count;
+    int64_t now, first;
+    double measured;
+
+    twist__pacer_init(&pacer, PACER_DEFAULT_BURST, 0);
+
+    now = 0;
+    initial = 0;
+
+    while (twist__pacer_can_send(&pacer, rate, MSS, now)) {
+        twist__pacer_sent(&pacer, MSS);
+        initial++;
+    }
+
+    first = -1;
+    count = 0;
+
+    while (now < (int64_t) SECONDS * 1000000000) {
+        while (!twist__pacer_can_send(&pacer, rate, MSS, now))
+            now = twist__pacer_next(&pacer, rate, MSS, now);
+
+        twist__pacer_sent(&pacer, MSS);
+
+        /* Measure the rate from the first paced packet onwards. */
+        if (first < 0)
+            first = now;
+        else
+            count++;
+    }
+
+    measured = (now > first ? (double) count * MSS / ((double) (now - first) / 1e9) : 0);
+
+    printf("%12lu %10d %16lu %16.1f\n", (unsigned long) rate, PACER_DEFAULT_BURST,
+           initial, measured);
+
+    if (initial != PACER_DEFAULT_BURST / MSS) {
+        fprintf(stderr, "unexpected initial burst at %lu B/s\n", (unsigned long) rate);
+        return 1;
+    }
+
+    if (count > 0 && (measured < (double) rate - 1 || measured > (double) rate + 1)) {
+        fprintf(stderr, "unexpected paced rate at %lu B/s\n", (unsigned long) rate);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#else
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <netinet/in.h>
+
+#include "src/mem.h"
+#include "src/packet.h"
+#include "src/ring.h"
+
+
+/* SPSC ring throughput benchmark. A producer thread pushes PACKETS datagrams
+ * through a ring to a consumer thread, which reads every payload byte, as a
+ * protocol thread feeding them to `twist_drain` would. The two threads are
+ * pinned to separate cores (on Linux), so all communication goes through the
+ * cache coherency protocol. A side which finds the ring full (or empty)
+ * yields, so the benchmark still completes on a single core. */
+#define PACKETS  10000000
+
+
+/* Shared benchmark state. */
+struct bench {
+    struct twist__ring ring;
+    uint64_t checksum;
+};
+
+
+/* Static functions. */
+static double run(size_t size, size_t len);
+static void * consume(void * arg);
+static void pin(int cpu);
+static double elapsed(const struct timespec * start);
+
+
+int main(int argc, char ** argv) {
+    static const size_t sizes[] = { 256, 4096 };
+    static const size_t lens[] = { 64, 1200 };
+    double secs;
+    size_t i, j;
+
+    (void) argc;
+    (void) argv;
+
+    printf("%8s %8s %12s %14s %12s\n", "slots", "payload", "packets", "Mpackets/s", "ns/packet");
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (j = 0; j < sizeof(lens) / sizeof(lens[0]); j++) {
+            secs = run(sizes[i], lens[j]);
+
+            printf("%8lu %8lu %12lu %14.2f %12.1f\n", (unsigned long) sizes[i],
+                   (unsigned long) lens[j], (unsigned long) PACKETS,
+                   PACKETS / secs / 1e6, secs * 1e9 / PACKETS);
+        }
+    }
+
+    return 0;
+}
+
+
+/* Push PACKETS packets with `len` byte payloads through a ring with `size`
+ * slots, returning the elapsed wall clock time in seconds. */
+static double run(size_t size, size_t len) {
+    static struct bench bench;
+    static uint8_t payload[RING_MAX_PAYLOAD];
+    struct twist__packet * pkt;
+    struct sockaddr_in addr;
+    struct twist__mem mem;
+    struct timespec start;
+    pthread_t consumer;
+    double secs;
+    long n;
+
+    twist__mem_init(&mem, NULL, 0);
+    if (twist__ring_init(&bench.ring, size, &mem) != TWIST_OK) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    bench.checksum = 0;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(4000);
+
+    memset(payload, 1, len);
+
+    pin(0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (pthread_create(&consumer, NULL, consume, &bench) != 0) {
+        fprintf(stderr, "failed to start consumer thread\n");
+        exit(1);
+    }
+
+    for (n = 0; n < PACKETS; n++) {
+        while ((pkt = twist__ring_reserve(&bench.ring)) == NULL)
+            sched_yield();
+
+        twist__packet_init(pkt, (const struct sockaddr *) &addr, sizeof(addr), payload, len);
+        twist__ring_publish(&bench.ring);
+    }
+
+    pthread_join(consumer, NULL);
+    secs = elapsed(&start);
+
+    if (bench.checksum != (uint64_t) PACKETS * len) {
+        fprintf(stderr, "lost or corrupted packets\n");
+        exit(1);
+    }
+
+    twist__ring_clear(&bench.ring);
+
+    return secs;
+}
+
+
+/* Consumer thread: drain PACKETS packets from the ring, summing up their
+ * payload bytes. */
+static void * consume(void * arg) {
+    struct bench * bench = arg;
+    struct twist__packet * pkt;
+    uint64_t sum;
+    size_t i;
+    long n;
+
+    pin(1);
+
+    sum = 0;
+
+    for (n = 0; n < PACKETS; n++) {
+        while ((pkt = twist__ring_peek(&bench->ring)) == NULL)
+            sched_yield();
+
+        for (i = 0; i < pkt->len; i++)
+            sum += pkt->payload[i];
+
+        twist__ring_release(&bench->ring);
+    }
+
+    bench->checksum = sum;
+
+    return NULL;
+}
+
+
+/* Pin the calling thread to a particular CPU, where supported. */
+static void pin(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        fprintf(stderr, "warning: failed to pin thread to CPU %d\n", cpu);
+#else
+    (void) cpu;
+#endif
+}
+
+
+/* Get the number of seconds elapsed since `start`. */
+static double elapsed(const struct timespec * start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
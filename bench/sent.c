@@ -0,0 +1,302 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "src/mem.h"
+#include "src/sent.h"
+
+
+/* Driver for the sent packet tracker. Each scenario plays a sequence of
+ * sends, acknowledgements and timeouts against a fresh `twist__sent`, the
+ * way a connection would, and checks the bytes in flight, the delivered
+ * stream offset and the bytes reported as newly acknowledged along the way.
+ * Every packet carries LEN bytes, and packet `n` sent as new data carries
+ * stream offset `n * LEN` unless noted otherwise. Exits with a non-zero
+ * status if any check fails. */
+#define LEN  100
+
+/* Time between consecutive events, in nanoseconds. */
+#define STEP  1000000
+
+
+/* Check a condition, reporting it (but carrying on) if it doesn't hold. */
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s: check failed: %s\n", scenario, #cond); \
+            failed = 1;                                                 \
+        }                                                               \
+    } while (0)
+
+
+/* Static functions. */
+static void spurious_loss(void);
+static void lost_probe(void);
+static void late_ack(void);
+static void growth(void);
+
+static void begin(struct twist__sent * sent, const char * name);
+static uint64_t transmit(struct twist__sent * sent, uint64_t offset, uint64_t orig);
+static void ack(struct twist__sent * sent, uint64_t start, uint64_t end,
+                struct twist__sent_result * res);
+
+
+/* State shared by the scenarios. */
+static struct twist__mem mem;
+static const char * scenario;
+static int64_t now;
+static int failed;
+
+
+int main(int argc, char ** argv) {
+    (void) argc;
+    (void) argv;
+
+    twist__mem_init(&mem, NULL, 0);
+
+    spurious_loss();
+    lost_probe();
+    late_ack();
+    growth();
+
+    if (mem.used != 0) {
+        fprintf(stderr, "leaked %lu bytes\n", (unsigned long) mem.used);
+        failed = 1;
+    }
+
+    printf("%s\n", (failed ? "FAIL" : "ok"));
+
+    return (failed ? 1 : 0);
+}
+
+
+/* A packet is declared lost by packet threshold, and then its original
+ * acknowledgement turns up. Its bytes are counted as acknowledged exactly
+ * once, and nothing is left to retransmit. */
+static void spurious_loss(void) {
+    struct twist__sent_result res;
+    struct twist__sent sent;
+    uint64_t n;
+
+    begin(&sent, "spurious loss");
+
+    for (n = 0; n < 4; n++)
+        transmit(&sent, n * LEN, SENT_NONE);
+
+    ack(&sent, 1, 4, &res);
+    CHECK(res.acked == 3 * LEN);
+    CHECK(res.lost == LEN);
+    CHECK(sent.inflight == 0);
+    CHECK(sent.delivered == 0);
+
+    ack(&sent, 0, 1, &res);
+    CHECK(res.acked == LEN);
+    CHECK(res.lost == 0);
+    CHECK(sent.inflight == 0);
+
+    CHECK(twist__sent_next_lost(&sent, &n) == NULL);
+    CHECK(sent.delivered == 4 * LEN);
+
+    twist__sent_clear(&sent);
+}
+
+
+/* A tail loss probe is sent on behalf of a packet still in flight, and both
+ * go missing. The original is queued for retransmission once, and when the
+ * retransmission arrives, its bytes are counted once. */
+static void lost_probe(void) {
+    struct twist__sent_result res;
+    const struct twist__sent_packet * pkt;
+    struct twist__sent sent;
+    uint64_t n, orig;
+
+    begin(&sent, "lost probe");
+
+    transmit(&sent, 0, SENT_NONE);
+
+    pkt = twist__sent_probe(&sent, &orig);
+    CHECK(pkt != NULL && orig == 0);
+    transmit(&sent, 0, orig);
+    CHECK(sent.inflight == 2 * LEN);
+
+    /* Packets 2 to 5 carry new data, from stream offset LEN onwards. */
+    for (n = 1; n < 5; n++)
+        transmit(&sent, n * LEN, SENT_NONE);
+
+    ack(&sent, 2, 6, &res);
+    CHECK(res.acked == 4 * LEN);
+    CHECK(res.lost == 2 * LEN);
+    CHECK(sent.inflight == 0);
+    CHECK(sent.delivered == 0);
+
+    pkt = twist__sent_next_lost(&sent, &n);
+    CHECK(pkt != NULL && n == 0 && pkt->offset == 0);
+    CHECK(twist__sent_next_lost(&sent, &orig) == NULL);
+
+    n = transmit(&sent, 0, n);
+    CHECK(sent.inflight == LEN);
+
+    ack(&sent, n, n + 1, &res);
+    CHECK(res.acked == LEN);
+    CHECK(sent.inflight == 0);
+    CHECK(sent.delivered == 5 * LEN);
+
+    twist__sent_clear(&sent);
+}
+
+
+/* Nothing is acknowledged, so two probe timeouts are followed by a
+ * retransmission timeout which declares everything lost. One packet is
+ * retransmitted before the original acknowledgements arrive after all, and
+ * the retransmission's own acknowledgement then adds nothing. */
+static void late_ack(void) {
+    struct twist__sent_result res;
+    struct twist__sent sent;
+    uint64_t n, retx;
+    int i;
+
+    begin(&sent, "late ack");
+
+    transmit(&sent, 0, SENT_NONE);
+    transmit(&sent, LEN, SENT_NONE);
+
+    for (i = 0; i < 2; i++) {
+        now = twist__sent_timeout(&sent);
+        twist__sent_on_timeout(&sent, now, &res);
+        CHECK(res.probe && !res.rto);
+        CHECK(sent.inflight == 2 * LEN);
+    }
+
+    now = twist__sent_timeout(&sent);
+    twist__sent_on_timeout(&sent, now, &res);
+    CHECK(res.rto);
+    CHECK(res.lost == 2 * LEN);
+    CHECK(sent.inflight == 0);
+
+    CHECK(twist__sent_next_lost(&sent, &n) != NULL && n == 0);
+    retx = transmit(&sent, 0, n);
+    CHECK(sent.inflight == LEN);
+
+    ack(&sent, 0, 2, &res);
+    CHECK(res.acked == 2 * LEN);
+    CHECK(sent.inflight == LEN);
+    CHECK(sent.delivered == LEN);
+
+    ack(&sent, retx, retx + 1, &res);
+    CHECK(res.acked == 0);
+    CHECK(sent.inflight == 0);
+
+    /* Packet 1 is still queued, but was acknowledged, so it's skipped. */
+    CHECK(twist__sent_next_lost(&sent, &n) == NULL);
+    CHECK(sent.delivered == 2 * LEN);
+    CHECK(sent.head == sent.tail);
+
+    twist__sent_clear(&sent);
+}
+
+
+/* The ring grows while `head` is well into it, so the records that wrapped
+ * around have to be redistributed. One packet on the far side of the wrap is
+ * lost, and retransmitted from the right stream offset. */
+static void growth(void) {
+    const struct twist__sent_packet * pkt;
+    struct twist__sent_result res;
+    struct twist__sent sent;
+    uint64_t n, size;
+
+    begin(&sent, "growth");
+
+    for (n = 0; n < 60; n++)
+        transmit(&sent, n * LEN, SENT_NONE);
+
+    ack(&sent, 0, 50, &res);
+    CHECK(res.acked == 50 * LEN);
+    CHECK(sent.head == 50);
+    CHECK(sent.delivered == 50 * LEN);
+
+    size = sent.size;
+
+    for (n = 60; n < 160; n++)
+        transmit(&sent, n * LEN, SENT_NONE);
+
+    CHECK(sent.size > size);
+    CHECK(sent.inflight == 110 * LEN);
+
+    ack(&sent, 50, 55, &res);
+    CHECK(res.acked == 5 * LEN);
+    CHECK(sent.delivered == 55 * LEN);
+
+    ack(&sent, 56, 160, &res);
+    CHECK(res.acked == 104 * LEN);
+    CHECK(res.lost == LEN);
+    CHECK(sent.inflight == 0);
+    CHECK(sent.delivered == 55 * LEN);
+
+    pkt = twist__sent_next_lost(&sent, &n);
+    CHECK(pkt != NULL && n == 55 && pkt->offset == 55 * LEN);
+
+    n = transmit(&sent, 55 * LEN, n);
+
+    ack(&sent, n, n + 1, &res);
+    CHECK(res.acked == LEN);
+    CHECK(sent.inflight == 0);
+    CHECK(sent.delivered == 160 * LEN);
+
+    twist__sent_clear(&sent);
+}
+
+
+/* Initialize a tracker for a new scenario. */
+static void begin(struct twist__sent * sent, const char * name) {
+    scenario = name;
+    now = STEP;
+
+    if (twist__sent_init(sent, &mem) != TWIST_OK) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+}
+
+
+/* Send a packet with LEN bytes of data starting at `offset`, on behalf of
+ * `orig` if it's a retransmission, and return its number. */
+static uint64_t transmit(struct twist__sent * sent, uint64_t offset, uint64_t orig) {
+    uint64_t number;
+
+    now += STEP;
+
+    if (twist__sent_add(sent, offset, LEN, orig, now, &number) != TWIST_OK) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    return number;
+}
+
+
+/* Acknowledge packets `start` up to but not including `end`. */
+static void ack(struct twist__sent * sent, uint64_t start, uint64_t end,
+                struct twist__sent_result * res) {
+    struct twist__range range;
+
+    now += STEP;
+
+    range.start = start;
+    range.end = end;
+
+    twist__sent_on_ack(sent, &range, 1, 0, now, res);
+}
@@ -0,0 +1,166 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "src/conn.h"
+#include "src/mem.h"
+#include "src/timers.h"
+
+
+/* Timer churn benchmark. Every connection starts out with an idle timeout,
+ * then the clock advances in 1 ms steps. On each step a fraction of the
+ * connections receive a packet, which re-arms a short (retransmission or
+ * acknowledgement) timer, and all expired connections are ticked and handed
+ * a fresh timer, as `twist_tick` would do. Each socket size is run with one
+ * in a thousand and one in a hundred connections active per step. */
+#define STEP          1000000
+#define STEPS         2000
+#define IDLE_TIMEOUT  30000000000
+#define SHORT_TIMER   50000000
+
+
+/* Static functions. */
+static double run(int type, struct twist__conn * conns, size_t count, size_t busy,
+                  unsigned long * ops);
+static int64_t timer(int64_t now, int idle);
+static uint64_t rnd(void);
+
+
+/* State of the xorshift generator behind `rnd`. It's reset at the start of
+ * every run, so both implementations see the same workload. */
+static uint64_t seed;
+
+
+int main(int argc, char ** argv) {
+    static const size_t counts[] = { 10000, 100000, 1000000 };
+    static const size_t loads[] = { 1000, 100 };
+    struct twist__conn * conns;
+    unsigned long heap_ops, wheel_ops;
+    double heap, wheel;
+    size_t i, j;
+
+    (void) argc;
+    (void) argv;
+
+    printf("%10s %8s %12s %12s %14s %14s\n", "conns", "active",
+           "heap ops", "wheel ops", "heap ns/op", "wheel ns/op");
+
+    for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        conns = calloc(counts[i], sizeof(*conns));
+        if (conns == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        for (j = 0; j < sizeof(loads) / sizeof(loads[0]); j++) {
+            heap = run(TWIST_TIMERS_HEAP, conns, counts[i], counts[i] / loads[j], &heap_ops);
+            wheel = run(TWIST_TIMERS_WHEEL, conns, counts[i], counts[i] / loads[j], &wheel_ops);
+
+            printf("%10lu %7s%lu %12lu %12lu %14.1f %14.1f\n", (unsigned long) counts[i],
+                   "1/", (unsigned long) loads[j], heap_ops, wheel_ops,
+                   heap * 1e9 / (double) heap_ops, wheel * 1e9 / (double) wheel_ops);
+        }
+
+        free(conns);
+    }
+
+    return 0;
+}
+
+
+/* Run the benchmark against one timer implementation with `busy` active
+ * connections per step, returning the elapsed CPU time in seconds and storing
+ * the number of timer operations in `ops`. */
+static double run(int type, struct twist__conn * conns, size_t count, size_t busy,
+                  unsigned long * ops) {
+    struct twist__timers timers;
+    struct twist__conn * conn;
+    struct twist__mem mem;
+    int64_t now;
+    size_t i, n;
+    clock_t start;
+    int step;
+
+    twist__mem_init(&mem, NULL, 0);
+    if (twist__timers_init(&timers, type, &mem) != TWIST_OK) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    now = STEP;
+    *ops = 0;
+    seed = 88172645463325252ULL;
+
+    start = clock();
+
+    for (i = 0; i < count; i++) {
+        conns[i].local_cookie = i + 1;
+        conns[i].next_tick = timer(now, 1);
+        twist__timers_add(&timers, &conns[i]);
+    }
+
+    for (step = 0; step < STEPS; step++) {
+        now += STEP;
+
+        for (n = 0; n < busy; n++) {
+            conn = &conns[rnd() % count];
+            conn->next_tick = timer(now, 0);
+            twist__timers_fix(&timers, conn);
+        }
+
+        twist__timers_advance(&timers, now);
+
+        while ((conn = twist__timers_expire(&timers, now)) != NULL) {
+            conn->next_tick = timer(now, rnd() % 4 == 0);
+            twist__timers_fix(&timers, conn);
+            (*ops)++;
+        }
+
+        /* The socket looks up its next deadline after every operation. */
+        twist__timers_next(&timers);
+        *ops += busy;
+    }
+
+    for (i = 0; i < count; i++)
+        twist__timers_remove(&timers, &conns[i]);
+
+    *ops += 2 * count;
+
+    twist__timers_clear(&timers);
+
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+/* Pick a new deadline: either an idle timeout or a short timer. */
+static int64_t timer(int64_t now, int idle) {
+    if (idle)
+        return now + IDLE_TIMEOUT - (int64_t) (rnd() % (IDLE_TIMEOUT / 10));
+    else
+        return now + 1 + (int64_t) (rnd() % SHORT_TIMER);
+}
+
+
+/* Xorshift generator, so runs are repeatable across platforms. */
+static uint64_t rnd(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+
+    return seed;
+}
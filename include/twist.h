@@ -19,6 +19,7 @@
 #include <stdint.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 
 /* Status codes. */
@@ -30,18 +31,216 @@
 #define TWIST_ETRANS  (-5)
 
 
+/* Connection timer implementations. */
+#define TWIST_TIMERS_HEAP   0
+#define TWIST_TIMERS_WHEEL  1
+
+
+/* Connection lookup hash functions. */
+#define TWIST_HASH_FAST     0
+#define TWIST_HASH_SIPHASH  1
+
+
+/* Congestion control algorithms. */
+#define TWIST_CC_CUBIC  0
+#define TWIST_CC_RENO   1
+#define TWIST_CC_BBR    2
+
+
+/* Readiness events reported by `twist_poll`. */
+#define TWIST_READABLE    0x01
+#define TWIST_WRITABLE    0x02
+#define TWIST_ACCEPTABLE  0x04
+#define TWIST_CLOSED      0x08
+
+
 /* Opaque socket and connection handles. */
 struct twist_sock;
 struct twist_conn;
 
+/* Opaque handle for a group of sockets sharded by connection cookie. */
+struct twist_sock_group;
 
-/* TODO: Documentation. */
-int twist_create(struct twist_sock ** sockptr);
+
+/* Custom memory allocator. Every allocation made by a socket (or a socket
+ * group) is routed through these functions, each of which is passed `priv`,
+ * which makes it possible to e.g. give every shard its own NUMA-local arena.
+ * Allocations are always freed or resized with their exact size, so sized
+ * deallocation interfaces can be used directly. The `resize` function must
+ * leave `ptr` untouched and return NULL on failure, like `realloc`. */
+struct twist_allocator {
+    void * (*alloc)(size_t size, void * priv);
+    void * (*resize)(void * ptr, size_t old_size, size_t size, void * priv);
+    void (*release)(void * ptr, size_t size, void * priv);
+    void * priv;
+};
+
+
+/* Options used when creating a socket. Zeroed fields select the defaults. */
+struct twist_opts {
+    /* Data structure used to schedule connection timers. TWIST_TIMERS_HEAP
+     * (the default) is a min-heap, while TWIST_TIMERS_WHEEL is a hierarchical
+     * timing wheel which reschedules connections in constant time, and pays
+     * off with very large numbers of mostly idle connections. */
+    int timers;
+
+    /* Hash function used when looking up connections by cookie. Because all
+     * cookies are random values generated by the socket itself, the keyed
+     * multiply-xorshift mixer selected by TWIST_HASH_FAST (the default) is
+     * sufficient; TWIST_HASH_SIPHASH selects the slower, hardened option. */
+    int hash;
+
+    /* Congestion control algorithm used by new connections: TWIST_CC_CUBIC
+     * (the default), TWIST_CC_RENO, or TWIST_CC_BBR, which paces packets at
+     * the estimated bottleneck bandwidth instead of reacting to loss, and
+     * keeps queues short on deeply buffered paths. Individual connections may
+     * use another algorithm; see `twist_set_cc`. */
+    int cc;
+
+    /* Packets are paced out at the rate chosen by the congestion controller
+     * instead of being sent in line-rate bursts, which overflow shallow switch
+     * buffers. Up to `pacing_burst` bytes (16 KiB by default, at most 1 GiB)
+     * may still be sent back to back after a connection has been idle. */
+    size_t pacing_burst;
+
+    /* Received packets are acknowledged in batches: once `ack_frequency`
+     * packets (2 by default, at most 256) have arrived, or `ack_delay`
+     * nanoseconds (25 ms by default, at most one second) after the first of
+     * them, whichever comes first. Acknowledgements are also piggybacked on
+     * outgoing data whenever possible. The peer may ask for a different
+     * frequency; see `twist_set_ack_frequency`. */
+    unsigned int ack_frequency;
+    int64_t ack_delay;
+
+    /* Retention policy for the socket's memory pool. Rather than freeing
+     * memory as soon as it's unused, the pool tracks a high-water mark of
+     * memory in use, which decays by half every `pool_window` nanoseconds
+     * (one second by default), and only releases memory beyond that mark.
+     * `pool_min` and `pool_max` bound the number of spare objects retained
+     * per size class; zero means no lower and no upper bound respectively. */
+    unsigned int pool_min;
+    unsigned int pool_max;
+    int64_t pool_window;
+
+    /* Memory allocator, or NULL to use `malloc` and friends. The allocator is
+     * copied, so the struct itself doesn't need to outlive the call. */
+    const struct twist_allocator * allocator;
+
+    /* Maximum number of bytes the socket may allocate, or 0 for no limit.
+     * Once 7/8 of the budget is in use, the socket starts shedding load by
+     * ignoring new handshakes and shrinking advertised receive windows, so
+     * that existing connections can keep going. For socket groups, the budget
+     * applies to each shard separately. Packets are carved out of 2 MiB
+     * chunks, so the budget must leave room for at least one chunk on top of
+     * the socket's own tables (around 10 KiB); smaller budgets are rejected
+     * with TWIST_EINVAL. */
+    size_t mem_budget;
+
+    /* Initial and maximum receive window of each connection, in bytes. The
+     * window starts out at `recv_window` (64 KiB by default, and no less than
+     * 16 KiB), and grows towards `recv_window_max` (4 MiB or `recv_window`,
+     * whichever is larger, by default) as long as the application keeps up
+     * with the incoming data. */
+    size_t recv_window;
+    size_t recv_window_max;
+
+    /* High and low water marks for each connection's send buffer, in bytes.
+     * Writes are cut short once `send_high` bytes (1 MiB by default) are
+     * waiting to be sent, after which the connection isn't reported as
+     * writable again until its buffer has drained to `send_low` bytes (a
+     * quarter of `send_high` by default). */
+    size_t send_high;
+    size_t send_low;
+};
+
+
+/* Memory statistics for a socket, as reported by `twist_query_sock`. All
+ * values are in bytes, except `connections`. */
+struct twist_sock_stats {
+    /* Total memory currently allocated by the socket, and its budget (or 0
+     * if there is none). */
+    size_t memory;
+    size_t budget;
+
+    /* Memory reserved by the socket's object pool, and the part of it that's
+     * currently handed out as packets or buffer slabs. */
+    size_t pool_reserved;
+    size_t pool_used;
+
+    /* Memory used by the connection lookup table and timers. */
+    size_t tables;
+
+    /* Number of open connections. */
+    size_t connections;
+};
+
+
+/* Buffer statistics for a connection, as reported by `twist_query_conn`. */
+struct twist_conn_stats {
+    /* Bytes of data waiting to be read, and the memory and number of slabs
+     * holding that data. */
+    size_t read_buffered;
+    size_t read_memory;
+    size_t read_slabs;
+
+    /* The same, for data waiting to be sent. */
+    size_t write_buffered;
+    size_t write_memory;
+    size_t write_slabs;
+};
+
+
+/* A readiness event returned by `twist_poll`. TWIST_ACCEPTABLE events are
+ * reported for the socket as a whole, and have a NULL `conn`. */
+struct twist_event {
+    struct twist_conn * conn;
+    unsigned int events;
+};
+
+
+/* Describes a single received datagram in a call to `twist_recv_many`. The
+ * `status` field is filled in by the library, and holds the outcome of
+ * processing that particular datagram (TWIST_OK or a negative error code). */
+struct twist_datagram {
+    const struct sockaddr * addr;
+    socklen_t addrlen;
+
+    const uint8_t * buf;
+    size_t len;
+
+    int status;
+};
+
+
+/* TODO: Documentation. The `opts` argument may be NULL. */
+int twist_create(struct twist_sock ** sockptr, const struct twist_opts * opts);
 
 /* TODO: Documentation. */
 int twist_destroy(struct twist_sock ** sockptr);
 
 
+/* Create a group of `count` independent sockets ("shards"), each of which
+ * may be driven by a different thread. Every connection cookie issued by a
+ * shard encodes that shard's index, and handshake tickets issued by one shard
+ * are accepted by all of them. The `opts` argument may be NULL. */
+int twist_group_create(struct twist_sock_group ** groupptr, unsigned int count,
+                       const struct twist_opts * opts);
+
+/* Destroy a socket group and all of its shards. Fails with TWIST_EAGAIN if any
+ * shard still has open connections. */
+int twist_group_destroy(struct twist_sock_group ** groupptr);
+
+/* Get the shard with a particular index. */
+struct twist_sock * twist_group_shard(struct twist_sock_group * group, unsigned int index);
+
+/* Determine which shard should process a received datagram. This function
+ * only reads immutable state, and can safely be called from any number of
+ * receiving threads without locking. */
+unsigned int twist_group_route(const struct twist_sock_group * group,
+                               const struct sockaddr * addr, socklen_t addrlen,
+                               const uint8_t * buf, size_t len);
+
+
 /* TODO: Documentation. */
 int twist_tick(struct twist_sock * sock, int64_t now);
 
@@ -50,9 +249,61 @@ int twist_recv(struct twist_sock * sock,
                const struct sockaddr * addr, socklen_t addrlen,
                const uint8_t * buf, size_t len, int64_t now);
 
+/* Feed a batch of `count` received datagrams to the socket, all of which are
+ * considered to have arrived at `now`. Timers are only processed once per
+ * batch, making this considerably cheaper than calling `twist_recv` in a loop
+ * when draining `recvmmsg` style interfaces. The outcome of each datagram is
+ * stored in its `status` field; the return value reports errors affecting the
+ * batch as a whole. */
+int twist_recv_many(struct twist_sock * sock,
+                    struct twist_datagram * dgrams, size_t count, int64_t now);
+
 /* TODO: Documentation. */
 int64_t twist_next(struct twist_sock * sock);
 
+/* Fill in up to `max` events describing the connections whose state has
+ * changed since they were last reported: connections with new data to read
+ * (TWIST_READABLE), connections whose send buffers have drained after a write
+ * was cut short (TWIST_WRITABLE), and connections that have been closed by the
+ * peer or timed out (TWIST_CLOSED), plus a single event if there are new
+ * connections to accept (TWIST_ACCEPTABLE). Each connection is reported at
+ * most once per call, with all of its pending events combined, and events
+ * that don't fit are kept for the next call. Returns the number of events
+ * filled in. The cost is proportional to the number of events, not to the
+ * number of connections. */
+int twist_poll(struct twist_sock * sock, struct twist_event * events, int max);
+
+/* Get a snapshot of the socket's memory usage. */
+void twist_query_sock(struct twist_sock * sock, struct twist_sock_stats * stats);
+
+
+/* Attach a pair of lock-free single-producer/single-consumer rings, each with
+ * room for `size` packets (a power of two), to the socket. This lets a
+ * dedicated I/O thread exchange datagrams with the socket while a separate
+ * protocol thread makes all other calls. Once attached, outgoing packets are
+ * queued on the egress ring rather than passed to `send_packet`; if the ring
+ * is full they are dropped, as they would be by a congested network, and so
+ * are packets too large for a ring slot. Must be called before the I/O
+ * thread starts. */
+int twist_attach_rings(struct twist_sock * sock, size_t size);
+
+/* Protocol thread: process the datagrams queued by `twist_ring_push` since
+ * the last call, all of which are considered to have arrived at `now`. */
+int twist_drain(struct twist_sock * sock, int64_t now);
+
+/* I/O thread: queue a received datagram for the protocol thread. Fails with
+ * TWIST_EAGAIN if the ingress ring is full. */
+int twist_ring_push(struct twist_sock * sock,
+                    const struct sockaddr * addr, socklen_t addrlen,
+                    const uint8_t * buf, size_t len);
+
+/* I/O thread: get the next datagram to send. Fails with TWIST_EAGAIN if there
+ * is none. The datagram's fields remain valid until `twist_ring_release`. */
+int twist_ring_peek(struct twist_sock * sock, struct twist_datagram * dgram);
+
+/* I/O thread: discard the datagram returned by `twist_ring_peek`. */
+void twist_ring_release(struct twist_sock * sock);
+
 
 /* TODO: Documentation. */
 int twist_dial(struct twist_sock * sock, struct twist_conn ** connptr,
@@ -61,13 +312,74 @@ int twist_dial(struct twist_sock * sock, struct twist_conn ** connptr,
 /* TODO: Documentation. */
 int twist_accept(struct twist_sock * sock, struct twist_conn ** connptr, int64_t now);
 
+/* Select the congestion control algorithm used by a connection, overriding
+ * the socket's default. Meant to be called right after `twist_dial` or
+ * `twist_accept`; calling it later restarts the connection's congestion
+ * control from scratch. Fails with TWIST_EINVAL if `cc` is unknown. */
+int twist_set_cc(struct twist_conn * conn, int cc);
+
+/* Ask the peer to acknowledge every `packets` packets, or after at most
+ * `max_delay` nanoseconds. Acknowledging less often saves the peer work and
+ * reduces the number of packets on the return path, at the cost of slower
+ * loss recovery. Fails with TWIST_EINVAL if either value is out of range. */
+int twist_set_ack_frequency(struct twist_conn * conn, unsigned int packets, int64_t max_delay);
+
 
 /* TODO: Documentation. */
 ssize_t twist_read(struct twist_conn * conn, uint8_t * buf, size_t len);
 
-/* TODO: Documentation. */
+/* Fill in up to `iovcnt` iovecs pointing directly at the data waiting to be
+ * read from the connection, without copying or consuming any of it. Returns
+ * the number of iovecs used. The iovecs remain valid until the next call to
+ * `twist_consume` or `twist_read` on the connection, or until it's dropped,
+ * making it possible to e.g. `writev` received data without an intermediate
+ * copy. */
+int twist_peek(struct twist_conn * conn, struct iovec * iov, int iovcnt);
+
+/* Discard up to `len` bytes of data waiting to be read from the connection,
+ * typically after processing the data described by `twist_peek`. Returns the
+ * number of bytes discarded. */
+size_t twist_consume(struct twist_conn * conn, size_t len);
+
+/* Queue up to `len` bytes of data for sending. Returns the number of bytes
+ * queued, which is less than `len` if the connection's send buffer reached its
+ * high water mark, or TWIST_EAGAIN if it was already full; the application
+ * should then wait for `twist_writable` before writing again. */
 ssize_t twist_write(struct twist_conn * conn, const uint8_t * buf, size_t len);
 
+/* Get a pointer to at least `min_len` bytes (and at most a few kilobytes) of
+ * contiguous space at the end of the connection's write buffer, described by
+ * `iov`. The application can serialize data straight into that space and then
+ * call `twist_write_commit`, which saves the copy made by `twist_write`. Fails
+ * with TWIST_EINVAL if `min_len` is too large to be satisfied, or TWIST_EAGAIN
+ * if the send buffer is at its high water mark. */
+int twist_write_reserve(struct twist_conn * conn, size_t min_len, struct iovec * iov);
+
+/* Append the first `len` bytes of the space returned by the most recent call
+ * to `twist_write_reserve` to the connection's outgoing data, exactly as if
+ * they had been passed to `twist_write`. No other write may happen between
+ * the two calls. */
+int twist_write_commit(struct twist_conn * conn, size_t len);
+
+/* Move up to `len` bytes of data waiting to be read from `src` to the end of
+ * `dst`'s outgoing data, as if by `twist_read` followed by `twist_write`.
+ * When both connections belong to the same socket, buffered data is moved
+ * without being copied, making this the cheapest way to relay a stream from
+ * one connection to another. As with `twist_write`, no more data is moved
+ * than `dst`'s send buffer has room for. Returns the number of bytes moved, or
+ * TWIST_EAGAIN if `dst`'s send buffer is full. */
+ssize_t twist_splice(struct twist_conn * dst, struct twist_conn * src, size_t len);
+
+/* Returns a non-zero value if the connection will accept more data. After a
+ * write has been cut short, this stays zero until the send buffer has drained
+ * to its low water mark. */
+int twist_writable(struct twist_conn * conn);
+
+/* Change the high and low water marks of the connection's send buffer (see
+ * `twist_opts`). Fails with TWIST_EINVAL unless `0 < high` and
+ * `low <= high`. */
+int twist_set_send_buffer(struct twist_conn * conn, size_t high, size_t low);
+
 /* TODO: Documentation. */
 int twist_flush(struct twist_conn * conn);
 
@@ -77,5 +389,8 @@ int twist_finish(struct twist_conn * conn);
 /* TODO: Documentation. */
 int twist_drop(struct twist_conn ** connptr);
 
+/* Get a snapshot of the connection's buffer usage. */
+void twist_query_conn(struct twist_conn * conn, struct twist_conn_stats * stats);
+
 
 #endif
@@ -0,0 +1,129 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <string.h>
+
+#include "src/ack.h"
+
+
+/* Initialize the scheduler, acknowledging every `threshold` packets or after
+ * `max_delay` nanoseconds. */
+void twist__ack_init(struct twist__ack * ack, unsigned int threshold, int64_t max_delay) {
+    ack->count = 0;
+    ack->largest_time = 0;
+    ack->pending = 0;
+    ack->deadline = 0;
+
+    twist__ack_frequency(ack, threshold, max_delay);
+}
+
+
+/* Change the acknowledgement frequency. Values out of range are clamped. */
+void twist__ack_frequency(struct twist__ack * ack, unsigned int threshold, int64_t max_delay) {
+    if (threshold < 1)
+        threshold = 1;
+    else if (threshold > ACK_MAX_THRESHOLD)
+        threshold = ACK_MAX_THRESHOLD;
+
+    if (max_delay < ACK_MIN_DELAY)
+        max_delay = ACK_MIN_DELAY;
+    else if (max_delay > ACK_MAX_DELAY)
+        max_delay = ACK_MAX_DELAY;
+
+    ack->threshold = threshold;
+    ack->max_delay = max_delay;
+
+    /* Apply the new delay to an acknowledgement that's already pending. */
+    if (ack->deadline != 0 && ack->deadline - ack->largest_time > max_delay)
+        ack->deadline = ack->largest_time + max_delay;
+}
+
+
+/* Record the receipt of a packet. Returns a non-zero value if the packet is
+ * a duplicate (or too old to tell). */
+int twist__ack_recv(struct twist__ack * ack, uint64_t number, int64_t now) {
+    struct twist__range * r;
+    int in_order;
+    size_t i;
+
+    in_order = (ack->count == 0 || number == ack->ranges[0].end);
+
+    /* Find the first range that doesn't lie entirely above `number`. */
+    for (i = 0; i < ack->count; i++)
+        if (number >= ack->ranges[i].start)
+            break;
+
+    if (i < ack->count && number < ack->ranges[i].end)
+        return 1;
+
+    if (i < ack->count && number == ack->ranges[i].end) {
+        /* Extend range `i` upwards, merging it with the range above it if
+         * the gap between them is now filled. */
+        r = &ack->ranges[i];
+        r->end++;
+
+        if (i > 0 && r->end == ack->ranges[i - 1].start) {
+            ack->ranges[i - 1].start = r->start;
+            memmove(r, r + 1, (ack->count - i - 1) * sizeof(*r));
+            ack->count--;
+        }
+    } else if (i > 0 && number + 1 == ack->ranges[i - 1].start) {
+        /* Extend the range above downwards. */
+        ack->ranges[i - 1].start = number;
+    } else {
+        /* Start a new range. If the array is full, the oldest range is
+         * forgotten; a packet older than all remembered ones can't be told
+         * apart from a duplicate, so it's treated as one. */
+        if (i == ACK_MAX_RANGES)
+            return 1;
+
+        if (ack->count == ACK_MAX_RANGES)
+            ack->count--;
+
+        memmove(&ack->ranges[i + 1], &ack->ranges[i], (ack->count - i) * sizeof(struct twist__range));
+        ack->ranges[i].start = number;
+        ack->ranges[i].end = number + 1;
+        ack->count++;
+    }
+
+    if (i == 0)
+        ack->largest_time = now;
+
+    /* Schedule the acknowledgement. */
+    ack->pending++;
+
+    if (!in_order || ack->pending >= ack->threshold)
+        ack->deadline = now;
+    else if (ack->deadline == 0)
+        ack->deadline = now + ack->max_delay;
+
+    return 0;
+}
+
+
+/* Fill in up to `max` ranges to acknowledge, newest first. */
+size_t twist__ack_build(struct twist__ack * ack, struct twist__range * ranges, size_t max,
+                        int64_t * delay, int64_t now) {
+    size_t n;
+
+    n = (ack->count < max ? ack->count : max);
+    memcpy(ranges, ack->ranges, n * sizeof(struct twist__range));
+
+    *delay = (n > 0 && now > ack->largest_time ? now - ack->largest_time : 0);
+
+    ack->pending = 0;
+    ack->deadline = 0;
+
+    return n;
+}
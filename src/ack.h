@@ -0,0 +1,98 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#ifndef LIBTWIST_ACK_H
+#define LIBTWIST_ACK_H
+
+#include "include/twist.h"
+#include "src/sent.h"
+
+
+/* Maximum number of ranges of received packet numbers remembered, and thus
+ * reported in a single acknowledgement. */
+#define ACK_MAX_RANGES  32
+
+/* Default and maximum number of packets received before an acknowledgement
+ * is sent. */
+#define ACK_DEFAULT_THRESHOLD  2
+#define ACK_MAX_THRESHOLD      256
+
+/* Default and maximum time an acknowledgement may be delayed, and the
+ * smallest delay a peer may request, in nanoseconds. */
+#define ACK_DEFAULT_DELAY  ((int64_t) 25000000)
+#define ACK_MAX_DELAY      ((int64_t) 1000000000)
+#define ACK_MIN_DELAY      ((int64_t) 1000000)
+
+
+/* The `twist__ack` struct decides when a connection acknowledges received
+ * packets. Rather than acknowledging every packet, which would double the
+ * packet rate, acknowledgements are sent once `threshold` packets have been
+ * received, or `max_delay` after the first unacknowledged one, whichever
+ * comes first. Whenever the connection sends a packet anyway, any pending
+ * acknowledgement rides along with it. Out-of-order packets are acknowledged
+ * right away, so the sender learns about losses quickly. */
+struct twist__ack {
+    /* Received packet numbers, as disjoint ranges sorted from newest to
+     * oldest. When the array fills up, the oldest range is forgotten. */
+    struct twist__range ranges[ACK_MAX_RANGES];
+    size_t count;
+
+    /* Receive time of the largest packet number. */
+    int64_t largest_time;
+
+    /* Number of packets received since the last acknowledgement, and when
+     * the next acknowledgement is due (0 if none is pending). */
+    unsigned int pending;
+    int64_t deadline;
+
+    /* Acknowledgement frequency, as requested by the peer. */
+    unsigned int threshold;
+    int64_t max_delay;
+};
+
+
+/* Initialize the scheduler, acknowledging every `threshold` packets or after
+ * `max_delay` nanoseconds. */
+void twist__ack_init(struct twist__ack * ack, unsigned int threshold, int64_t max_delay);
+
+/* Change the acknowledgement frequency, as requested by the peer. Values out
+ * of range are clamped. */
+void twist__ack_frequency(struct twist__ack * ack, unsigned int threshold, int64_t max_delay);
+
+
+/* Record the receipt of a packet. Returns a non-zero value if the packet is
+ * a duplicate (or too old to tell), in which case it should be discarded. */
+int twist__ack_recv(struct twist__ack * ack, uint64_t number, int64_t now);
+
+/* Get the time at which an acknowledgement must be sent, or 0 if none is
+ * pending. Meant to be folded into the connection's `next_tick`. */
+static inline int64_t twist__ack_deadline(const struct twist__ack * ack) {
+    return ack->deadline;
+}
+
+/* Returns a non-zero value if an acknowledgement is pending, and may be
+ * piggybacked on an outgoing packet. */
+static inline int twist__ack_pending(const struct twist__ack * ack) {
+    return (ack->pending > 0);
+}
+
+/* Fill in up to `max` ranges to acknowledge, newest first, and the time the
+ * largest packet was held before being acknowledged. Resets the scheduler,
+ * since an acknowledgement is about to be sent. Returns the number of ranges
+ * filled in. */
+size_t twist__ack_build(struct twist__ack * ack, struct twist__range * ranges, size_t max,
+                        int64_t * delay, int64_t now);
+
+
+#endif
@@ -0,0 +1,290 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include "src/cc.h"
+
+
+/* States. */
+#define BBR_STARTUP    0
+#define BBR_DRAIN      1
+#define BBR_PROBE_BW   2
+#define BBR_PROBE_RTT  3
+
+/* Gains, in thousandths. The startup gain is 2/ln(2), the smallest that
+ * still doubles the sending rate every round. */
+#define STARTUP_GAIN  2885
+#define DRAIN_GAIN    347
+#define CWND_GAIN     2000
+#define UNIT_GAIN     1000
+
+/* Number of phases in the PROBE_BW gain cycle. */
+#define CYCLE_LENGTH  8
+
+/* Number of rounds without 25% bandwidth growth after which startup ends. */
+#define FULL_BW_ROUNDS  3
+
+/* How often to probe for a lower RTT, and for how long, in nanoseconds. */
+#define PROBE_RTT_INTERVAL  ((int64_t) 10000000000)
+#define PROBE_RTT_DURATION  ((int64_t) 200000000)
+
+/* Smallest congestion window, in segments. */
+#define MIN_CWND  4
+
+
+/* Pacing gains used in each phase of PROBE_BW: probe for more bandwidth,
+ * drain the queue that may have built up, then cruise. */
+static const unsigned int cycle_gains[CYCLE_LENGTH] = {
+    1250, 750, 1000, 1000, 1000, 1000, 1000, 1000
+};
+
+
+/* Static functions. */
+static void bbr_init(struct twist__cc * cc, int64_t now);
+static void bbr_on_ack(struct twist__cc * cc, size_t acked, size_t inflight, int64_t now);
+static void bbr_on_loss(struct twist__cc * cc, size_t inflight, int64_t now);
+static uint64_t bbr_pacing_rate(struct twist__cc * cc);
+static void end_round(struct twist__cc * cc, int64_t now);
+static uint64_t max_bw(struct twist__bbr * bbr);
+static size_t bdp(struct twist__cc * cc, unsigned int gain);
+
+
+/* A simplified BBR, with BBRv2's loss response: losses put an upper bound on
+ * the amount of data in flight rather than being ignored. */
+const struct twist__cc_ops twist__bbr_ops = {
+    bbr_init,
+    bbr_on_ack,
+    bbr_on_loss,
+    bbr_pacing_rate
+};
+
+
+/* Reset BBR's state. */
+static void bbr_init(struct twist__cc * cc, int64_t now) {
+    struct twist__bbr * bbr = &cc->u.bbr;
+    unsigned int i;
+
+    bbr->state = BBR_STARTUP;
+
+    for (i = 0; i < BBR_BW_SLOTS; i++)
+        bbr->bw[i] = 0;
+
+    bbr->round = 0;
+    bbr->delivered = 0;
+    bbr->round_start = now;
+    bbr->full_bw = 0;
+    bbr->full_rounds = 0;
+    bbr->cycle = 0;
+    bbr->probe_rtt_done = 0;
+    bbr->probe_rtt_due = now + PROBE_RTT_INTERVAL;
+    bbr->inflight_hi = SIZE_MAX;
+}
+
+
+/* Update the model and derive a new congestion window. */
+static void bbr_on_ack(struct twist__cc * cc, size_t acked, size_t inflight, int64_t now) {
+    struct twist__bbr * bbr = &cc->u.bbr;
+    size_t target;
+
+    bbr->delivered += acked;
+
+    /* Without an RTT sample, there's no model yet; grow like slow start. */
+    if (cc->min_rtt == 0) {
+        cc->cwnd += acked;
+        return;
+    }
+
+    /* Rounds last one minimum RTT. */
+    if (now - bbr->round_start >= cc->min_rtt)
+        end_round(cc, now);
+
+    /* A minimum that expired without being matched means the queue may be
+     * hiding the real one, so probe right away (as Linux does). Only a lower
+     * or equal RTT sample postpones the next probe. */
+    if (cc->min_rtt_expired) {
+        cc->min_rtt_expired = 0;
+        if (bbr->state != BBR_PROBE_RTT)
+            bbr->probe_rtt_due = now;
+    } else if (bbr->probe_rtt_due < cc->min_rtt_stamp + PROBE_RTT_INTERVAL) {
+        bbr->probe_rtt_due = cc->min_rtt_stamp + PROBE_RTT_INTERVAL;
+    }
+
+    switch (bbr->state) {
+    case BBR_DRAIN:
+        /* Drain the queue built up during startup. */
+        if (inflight <= bdp(cc, UNIT_GAIN)) {
+            bbr->state = BBR_PROBE_BW;
+            bbr->cycle = 0;
+        }
+        break;
+
+    case BBR_PROBE_RTT:
+        if (now >= bbr->probe_rtt_done) {
+            bbr->state = (bbr->full_rounds >= FULL_BW_ROUNDS ? BBR_PROBE_BW : BBR_STARTUP);
+            bbr->probe_rtt_due = now + PROBE_RTT_INTERVAL;
+        }
+        break;
+
+    default:
+        /* Periodically cut the window to a few packets, so the queue drains
+         * and the true minimum RTT can be measured. */
+        if (now >= bbr->probe_rtt_due) {
+            bbr->state = BBR_PROBE_RTT;
+            bbr->probe_rtt_done = now + PROBE_RTT_DURATION;
+        }
+        break;
+    }
+
+    /* Compute the window. During startup, the model lags behind the actual
+     * delivery rate, so the window grows as in slow start. */
+    if (bbr->state == BBR_PROBE_RTT) {
+        target = MIN_CWND * cc->mss;
+        if (cc->cwnd > target)
+            cc->cwnd = target;
+        return;
+    }
+
+    if (bbr->state == BBR_STARTUP) {
+        cc->cwnd += acked;
+    } else {
+        target = bdp(cc, CWND_GAIN);
+        if (cc->cwnd + acked < target)
+            target = cc->cwnd + acked;
+
+        cc->cwnd = target;
+    }
+
+    if (cc->cwnd > bbr->inflight_hi)
+        cc->cwnd = bbr->inflight_hi;
+
+    if (cc->cwnd < MIN_CWND * cc->mss)
+        cc->cwnd = MIN_CWND * cc->mss;
+}
+
+
+/* Bound the amount of data in flight to 70% of what caused the loss, and
+ * stop looking for more bandwidth. */
+static void bbr_on_loss(struct twist__cc * cc, size_t inflight, int64_t now) {
+    struct twist__bbr * bbr = &cc->u.bbr;
+
+    (void) now;
+
+    if (inflight < cc->cwnd)
+        inflight = cc->cwnd;
+
+    bbr->inflight_hi = inflight / 10 * 7;
+    if (bbr->inflight_hi < MIN_CWND * cc->mss)
+        bbr->inflight_hi = MIN_CWND * cc->mss;
+
+    if (cc->cwnd > bbr->inflight_hi)
+        cc->cwnd = bbr->inflight_hi;
+
+    if (bbr->state == BBR_STARTUP) {
+        bbr->state = BBR_DRAIN;
+        bbr->full_rounds = FULL_BW_ROUNDS;
+    }
+}
+
+
+/* Pace at the estimated bottleneck bandwidth, scaled by the current gain. */
+static uint64_t bbr_pacing_rate(struct twist__cc * cc) {
+    struct twist__bbr * bbr = &cc->u.bbr;
+    unsigned int gain;
+    uint64_t bw;
+
+    /* Until the first round has been measured, pace according to the
+     * window. */
+    bw = max_bw(bbr);
+    if (bw == 0)
+        return twist__cc_window_rate(cc);
+
+    switch (bbr->state) {
+    case BBR_STARTUP:
+        gain = STARTUP_GAIN;
+        break;
+    case BBR_DRAIN:
+        gain = DRAIN_GAIN;
+        break;
+    case BBR_PROBE_BW:
+        gain = cycle_gains[bbr->cycle];
+        break;
+    default:
+        gain = UNIT_GAIN;
+        break;
+    }
+
+    return bw / 1000 * gain;
+}
+
+
+/* Record the delivery rate measured over the round that just ended, and move
+ * the state machine along. */
+static void end_round(struct twist__cc * cc, int64_t now) {
+    struct twist__bbr * bbr = &cc->u.bbr;
+    uint64_t bw;
+    int64_t us;
+
+    us = (now - bbr->round_start) / 1000;
+    if (us <= 0)
+        us = 1;
+
+    bbr->round++;
+    bbr->bw[bbr->round % BBR_BW_SLOTS] = (uint64_t) bbr->delivered * 1000000 / (uint64_t) us;
+    bbr->delivered = 0;
+    bbr->round_start = now;
+
+    bw = max_bw(bbr);
+
+    switch (bbr->state) {
+    case BBR_STARTUP:
+        /* Startup ends once the bandwidth stops growing. */
+        if (bw >= bbr->full_bw + bbr->full_bw / 4) {
+            bbr->full_bw = bw;
+            bbr->full_rounds = 0;
+        } else if (++bbr->full_rounds >= FULL_BW_ROUNDS) {
+            bbr->state = BBR_DRAIN;
+        }
+        break;
+
+    case BBR_PROBE_BW:
+        bbr->cycle = (bbr->cycle + 1) % CYCLE_LENGTH;
+
+        /* While probing for bandwidth, gradually lift the bound set by
+         * earlier losses. */
+        if (bbr->cycle == 0 && bbr->inflight_hi != SIZE_MAX)
+            bbr->inflight_hi += (bbr->inflight_hi / 8 > cc->mss ? bbr->inflight_hi / 8 : cc->mss);
+        break;
+    }
+}
+
+
+/* Get the maximum bandwidth sample from the last BBR_BW_SLOTS rounds. */
+static uint64_t max_bw(struct twist__bbr * bbr) {
+    uint64_t bw = 0;
+    unsigned int i;
+
+    for (i = 0; i < BBR_BW_SLOTS; i++)
+        if (bbr->bw[i] > bw)
+            bw = bbr->bw[i];
+
+    return bw;
+}
+
+
+/* Get the bandwidth-delay product, scaled by `gain`, in bytes. */
+static size_t bdp(struct twist__cc * cc, unsigned int gain) {
+    uint64_t bytes;
+
+    bytes = max_bw(&cc->u.bbr) * (uint64_t) (cc->min_rtt / 1000) / 1000000;
+    return (size_t) (bytes * gain / 1000);
+}
@@ -19,17 +19,27 @@
 
 /* Maximum capacity of a slab. */
 #define BUFFER_SLAB_SIZE                                                       \
-    (POOL_OBJECT_SIZE - sizeof(struct twist__buffer_slab))
+    (MAX_POOL_SIZE - sizeof(struct twist__buffer_slab))
 
 
 /* Calculate the amount of trailing unused space in a slab. */
 #define UNUSED(s)                                                              \
-    ((size_t) (((uint8_t *) (s)) + POOL_OBJECT_SIZE - (s)->end))
+    ((size_t) ((s)->limit - (s)->end))
+
+
+/* Calculate the size of the pool object holding a slab. */
+#define OBJSIZE(s)                                                             \
+    ((size_t) ((s)->limit - ((uint8_t *) (s))))
 
 
 /* Static functions. */
+static int reserve(struct twist__buffer * bufr, size_t len);
 static struct twist__buffer_slab * alloc(struct twist__buffer * bufr, size_t len);
 static size_t append(struct twist__buffer_slab * slab, const uint8_t * buf, size_t len);
+static size_t append_xor(struct twist__buffer_slab * slab, struct nectar_chacha20_ctx * chacha,
+                         const uint8_t * src, size_t len);
+static void advance(struct twist__buffer * bufr, size_t n);
+static size_t room(struct twist__buffer * bufr);
 
 
 /* Initialize the buffer's internal fields. */
@@ -37,64 +47,75 @@ void twist__buffer_init(struct twist__buffer * bufr, struct twist__pool * pool)
     bufr->head = NULL;
     bufr->tail = NULL;
     bufr->size = 0;
+    bufr->slabs = 0;
+    bufr->memory = 0;
+    bufr->high = SIZE_MAX;
+    bufr->low = SIZE_MAX;
+    bufr->blocked = 0;
     bufr->pool = pool;
 }
 
 
 /* Discard all data and return the buffer's slabs to the object pool. */
 void twist__buffer_clear(struct twist__buffer * bufr) {
-    struct twist__buffer_slab * first, * curr, * next;
-
-    /* If the buffer is already empty, do nothing. */
-    if (bufr->head == NULL)
-        return;
+    struct twist__buffer_slab * curr, * next;
 
     /* Free one slab at a time. */
-    first = bufr->head;
-    curr = first;
+    curr = bufr->head;
 
-    do {
+    while (curr != NULL) {
         next = curr->next;
         twist__pool_free(bufr->pool, curr);
         curr = next;
-    } while (curr != first);
+    }
 
     /* Reset internal fields. */
     bufr->head = NULL;
+    bufr->tail = NULL;
     bufr->size = 0;
+    bufr->slabs = 0;
+    bufr->memory = 0;
+    bufr->blocked = 0;
+}
+
+
+/* Set the buffer's high and low water marks. */
+void twist__buffer_limit(struct twist__buffer * bufr, size_t high, size_t low) {
+    bufr->high = high;
+    bufr->low = low;
+
+    if (bufr->size <= low)
+        bufr->blocked = 0;
 }
 
 
 /* Write a chunk of data to the buffer. Unless a necessary memory allocation
  * fails (in which case no data is written and TWIST_ENOMEM is returned), the
- * full write is guaranteed to complete successfully. The `len` argument must
- * not be greater than SSIZE_MAX. */
+ * write is guaranteed to complete successfully up to the high water mark.
+ * Fails with TWIST_EAGAIN if the buffer is already at its high water mark.
+ * The `len` argument must not be greater than SSIZE_MAX. */
 ssize_t twist__buffer_write(struct twist__buffer * bufr, const uint8_t * buf, size_t len) {
-    struct twist__buffer_slab * added;
-    size_t cap, rem, n;
+    size_t rem, n;
 
     /* Bail early with no input. */
     if (len == 0)
         return 0;
 
-    /* If there is already some free space in the last slab, take that
-     * into account. */
-    cap = (bufr->tail != NULL ? UNUSED(bufr->tail) : 0);
+    /* Cut the write short at the high water mark. */
+    n = room(bufr);
+    if (n < len) {
+        bufr->blocked = 1;
 
-    /* Allocate one or more additional slabs if we don't have enough room. */
-    if (cap < len) {
-        added = alloc(bufr, len - cap);
-        if (added == NULL)
-            return TWIST_ENOMEM;
+        if (n == 0)
+            return TWIST_EAGAIN;
 
-        if (bufr->head == NULL) {
-            bufr->head = added;
-            bufr->tail = added;
-        } else {
-            bufr->tail->next = added;
-        }
+        len = n;
     }
 
+    /* Make sure there's room for all of the data. */
+    if (reserve(bufr, len) != TWIST_OK)
+        return TWIST_ENOMEM;
+
     /* Write the user-provided input data into slabs. We use `bufr->tail` as
      * a cursor when walking through the list. */
     rem = len;
@@ -121,6 +142,131 @@ ssize_t twist__buffer_write(struct twist__buffer * bufr, const uint8_t * buf, si
 }
 
 
+/* Decrypt a chunk of ciphertext straight into the buffer's free space, by
+ * XORing it with the key stream produced by `chacha`. This is equivalent to
+ * decrypting into a temporary buffer and calling `twist__buffer_write`, but
+ * saves a copy. The same failure guarantees apply. Since the plaintext becomes
+ * readable immediately, the ciphertext should be authenticated first. */
+ssize_t twist__buffer_decrypt(struct twist__buffer * bufr, struct nectar_chacha20_ctx * chacha,
+                              const uint8_t * src, size_t len) {
+    size_t rem, n;
+
+    /* Bail early with no input. */
+    if (len == 0)
+        return 0;
+
+    /* Make sure there's room for all of the plaintext, before touching the
+     * key stream. */
+    if (reserve(bufr, len) != TWIST_OK)
+        return TWIST_ENOMEM;
+
+    /* Same as in `twist__buffer_write`, except that we decrypt rather than
+     * copy the data into each slab. */
+    rem = len;
+
+    for (;;) {
+        n = append_xor(bufr->tail, chacha, src, rem);
+
+        src += n;
+        rem -= n;
+
+        if (rem == 0)
+            break;
+
+        bufr->tail = bufr->tail->next;
+    }
+
+    bufr->size += len;
+
+    return (ssize_t) len;
+}
+
+
+/* Get a pointer to at least `min_len` bytes of contiguous free space at the
+ * end of the buffer, which the caller can write into directly before calling
+ * `twist__buffer_commit`. The space is described by `iov`, whose length may
+ * be larger than `min_len`. Fails with TWIST_EINVAL if `min_len` is larger
+ * than the largest slab, TWIST_EAGAIN if the buffer is at its high water mark,
+ * or TWIST_ENOMEM if a new slab couldn't be allocated. */
+int twist__buffer_reserve(struct twist__buffer * bufr, size_t min_len, struct iovec * iov) {
+    struct twist__buffer_slab * added, * prev;
+
+    if (min_len > BUFFER_SLAB_SIZE)
+        return TWIST_EINVAL;
+
+    /* The reserved space may take the buffer past its high water mark, but
+     * only by a single slab. */
+    if (room(bufr) == 0) {
+        bufr->blocked = 1;
+        return TWIST_EAGAIN;
+    }
+
+    /* If the last slab is too full, start a new one. Unlike `reserve`, we
+     * make it the new tail right away, because the space has to be
+     * contiguous. This means the buffer may end with an empty slab if the
+     * caller never commits any data, which everything else tolerates. */
+    if (bufr->tail == NULL || UNUSED(bufr->tail) < min_len || UNUSED(bufr->tail) == 0) {
+        added = alloc(bufr, min_len);
+        if (added == NULL)
+            return TWIST_ENOMEM;
+
+        /* An empty tail left by an earlier reservation would end up in the
+         * middle of the list, so replace it instead. Finding its predecessor
+         * takes a walk, but that only happens when reservations are abandoned
+         * and then retried with a larger `min_len`. */
+        if (bufr->tail != NULL && bufr->tail->start == bufr->tail->end) {
+            prev = NULL;
+            if (bufr->head != bufr->tail)
+                for (prev = bufr->head; prev->next != bufr->tail; prev = prev->next)
+                    ;
+
+            bufr->slabs--;
+            bufr->memory -= OBJSIZE(bufr->tail);
+
+            twist__pool_free(bufr->pool, bufr->tail);
+
+            if (prev != NULL) {
+                prev->next = NULL;
+            } else {
+                bufr->head = NULL;
+            }
+
+            bufr->tail = prev;
+        }
+
+        if (bufr->head == NULL) {
+            bufr->head = added;
+        } else {
+            bufr->tail->next = added;
+        }
+
+        bufr->tail = added;
+    }
+
+    iov->iov_base = bufr->tail->end;
+    iov->iov_len = UNUSED(bufr->tail);
+
+    return TWIST_OK;
+}
+
+
+/* Append `len` bytes, written into the space returned by the most recent
+ * `twist__buffer_reserve` call, to the buffer's data. Fails with TWIST_EINVAL
+ * if `len` is larger than the reserved space. */
+int twist__buffer_commit(struct twist__buffer * bufr, size_t len) {
+    if (len == 0)
+        return TWIST_OK;
+
+    if (bufr->tail == NULL || len > UNUSED(bufr->tail))
+        return TWIST_EINVAL;
+
+    bufr->tail->end += len;
+    bufr->size += len;
+
+    return TWIST_OK;
+}
+
+
 /* Read data from the buffer. This call can't fail, only return 0 when the
  * buffer is empty. The `len` argument must not be greater than SSIZE_MAX. */
 ssize_t twist__buffer_read(struct twist__buffer * bufr, uint8_t * buf, size_t len) {
@@ -141,25 +287,12 @@ ssize_t twist__buffer_read(struct twist__buffer * bufr, uint8_t * buf, size_t le
             n = len;
 
         memcpy(buf, slab->start, n);
-        slab->start += n;
-
-        /* Discard the slab if we've now emptied it. */
-        if (slab->start == slab->end) {
-            if (slab->next != NULL) {
-                bufr->head = slab->next;
-            } else {
-                bufr->head = NULL;
-                bufr->tail = NULL;
-            }
-
-            twist__pool_free(bufr->pool, slab);
-        }
+        advance(bufr, n);
 
         /* Update counters. */
         buf += n;
         len -= n;
 
-        bufr->size -= n;
         nread += n;
     }
 
@@ -167,40 +300,280 @@ ssize_t twist__buffer_read(struct twist__buffer * bufr, uint8_t * buf, size_t le
 }
 
 
+/* Fill in up to `count` iovecs describing the data at the front of the
+ * buffer, without copying or consuming it. Returns the number of iovecs used,
+ * which is 0 only if the buffer is empty. The iovecs remain valid until data
+ * is consumed from the buffer, or it is cleared. */
+size_t twist__buffer_peek(struct twist__buffer * bufr, struct iovec * iov, size_t count) {
+    struct twist__buffer_slab * slab;
+    size_t n;
+
+    /* Stop at the first empty slab, so callers never see zero-length
+     * iovecs. */
+    slab = bufr->head;
+
+    for (n = 0; n < count && slab != NULL && slab->start != slab->end; n++) {
+        iov[n].iov_base = slab->start;
+        iov[n].iov_len = (size_t) (slab->end - slab->start);
+
+        slab = slab->next;
+    }
+
+    return n;
+}
+
+
+/* Describe at most `len` bytes of data starting `offset` bytes into the
+ * buffer. */
+size_t twist__buffer_peek_at(struct twist__buffer * bufr, size_t offset, size_t len,
+                             struct iovec * iov, size_t count) {
+    struct twist__buffer_slab * slab;
+    size_t n, avail;
+
+    /* Skip whole slabs until we reach the one holding `offset`. */
+    for (slab = bufr->head; slab != NULL; slab = slab->next) {
+        avail = (size_t) (slab->end - slab->start);
+        if (offset < avail)
+            break;
+
+        offset -= avail;
+    }
+
+    for (n = 0; n < count && len > 0 && slab != NULL && slab->start != slab->end; n++) {
+        avail = (size_t) (slab->end - slab->start) - offset;
+        if (avail > len)
+            avail = len;
+
+        iov[n].iov_base = slab->start + offset;
+        iov[n].iov_len = avail;
+
+        len -= avail;
+        offset = 0;
+        slab = slab->next;
+    }
+
+    return n;
+}
+
+
+/* Discard up to `len` bytes from the front of the buffer, returning emptied
+ * slabs to the object pool. Returns the number of bytes discarded. */
+size_t twist__buffer_consume(struct twist__buffer * bufr, size_t len) {
+    struct twist__buffer_slab * slab;
+    size_t n, total;
+
+    total = 0;
+
+    while (len > 0 && bufr->size > 0) {
+        slab = bufr->head;
+
+        n = (size_t) (slab->end - slab->start);
+        if (n > len)
+            n = len;
+
+        advance(bufr, n);
+
+        len -= n;
+        total += n;
+    }
+
+    return total;
+}
+
+
+/* Move up to `len` bytes from the front of `src` to the end of `dst`. When
+ * both buffers share the same object pool, full slabs are moved between the
+ * buffers' lists rather than copied, so only partially consumed slabs at
+ * either end cost a copy. No more data is moved than `dst`'s high water mark
+ * allows. Returns the number of bytes moved, TWIST_EAGAIN if `dst` is already
+ * at its high water mark, or TWIST_ENOMEM if nothing could be moved because
+ * an allocation failed. */
+ssize_t twist__buffer_splice(struct twist__buffer * dst, struct twist__buffer * src, size_t len) {
+    struct twist__buffer_slab * slab;
+    size_t n, moved;
+
+    /* Never move more than `dst` will accept. */
+    n = room(dst);
+    if (n < len && src->size > n) {
+        dst->blocked = 1;
+
+        if (n == 0)
+            return TWIST_EAGAIN;
+
+        len = n;
+    }
+
+    moved = 0;
+
+    while (len > 0 && src->size > 0) {
+        slab = src->head;
+        n = (size_t) (slab->end - slab->start);
+
+        /* Copy the data if we only want part of the slab, if the slab would
+         * end up in the wrong pool, or if `dst` ends with an empty slab (left
+         * by `twist__buffer_reserve`) which has to be filled first. */
+        if (n > len || dst->pool != src->pool ||
+            (dst->tail != NULL && dst->tail->start == dst->tail->end)) {
+            if (n > len)
+                n = len;
+
+            if (twist__buffer_write(dst, slab->start, n) < 0)
+                break;
+
+            advance(src, n);
+        } else {
+            /* Unlink the slab from `src`... */
+            src->head = slab->next;
+            if (src->head == NULL)
+                src->tail = NULL;
+
+            src->size -= n;
+            src->slabs--;
+            src->memory -= OBJSIZE(slab);
+
+            if (src->size <= src->low)
+                src->blocked = 0;
+
+            /* ...and append it to `dst`. Any unused space at the end of the
+             * previous tail is simply left empty. */
+            slab->next = NULL;
+
+            if (dst->tail != NULL) {
+                dst->tail->next = slab;
+            } else {
+                dst->head = slab;
+            }
+
+            dst->tail = slab;
+            dst->size += n;
+            dst->slabs++;
+            dst->memory += OBJSIZE(slab);
+        }
+
+        len -= n;
+        moved += n;
+    }
+
+    if (moved == 0 && len > 0 && src->size > 0)
+        return TWIST_ENOMEM;
+
+    return (ssize_t) moved;
+}
+
+
 /* Get the number of bytes of data currently stored in the buffer. */
 size_t twist__buffer_size(struct twist__buffer * bufr) {
     return bufr->size;
 }
 
 
+/* Returns a non-zero value if the buffer will accept more data. */
+int twist__buffer_writable(struct twist__buffer * bufr) {
+    return (!bufr->blocked && bufr->size < bufr->high);
+}
+
+
+/* Get the number of slabs held by the buffer. */
+size_t twist__buffer_slabs(struct twist__buffer * bufr) {
+    return bufr->slabs;
+}
+
+
+/* Get the number of bytes of memory held by the buffer's slabs. */
+size_t twist__buffer_memory(struct twist__buffer * bufr) {
+    return bufr->memory;
+}
+
+
+/* Make sure there are at least `len` bytes of free space at the end of the
+ * buffer, by linking new slabs in after `bufr->tail` if necessary. The caller
+ * must fill all of that space, or the list will be left with empty slabs past
+ * the tail. */
+static int reserve(struct twist__buffer * bufr, size_t len) {
+    struct twist__buffer_slab * added;
+    size_t cap;
+
+    /* If there is already some free space in the last slab, take that
+     * into account. */
+    cap = (bufr->tail != NULL ? UNUSED(bufr->tail) : 0);
+
+    /* Allocate one or more additional slabs if we don't have enough room. */
+    if (cap < len) {
+        added = alloc(bufr, len - cap);
+        if (added == NULL)
+            return TWIST_ENOMEM;
+
+        if (bufr->head == NULL) {
+            bufr->head = added;
+            bufr->tail = added;
+        } else {
+            bufr->tail->next = added;
+        }
+    }
+
+    return TWIST_OK;
+}
+
+
 /* Allocate enough slabs to fit `cap` bytes of data. Returns the first item of
- * a singly linked list of slabs on success, or NULL if an allocation failed. */
+ * a singly linked list of slabs on success, or NULL if an allocation failed.
+ *
+ * Slabs are sized according to the larger of `cap` and the amount of data
+ * already in the buffer, so a buffer used for the occasional small message
+ * stays small, while one used for bulk transfers quickly grows into large
+ * slabs (with proportionally less header overhead and fewer list hops). */
 static struct twist__buffer_slab * alloc(struct twist__buffer * bufr, size_t cap) {
-    struct twist__buffer_slab * head, * next;
+    struct twist__buffer_slab * head, * tail, * next;
+    size_t want, size, slabs, memory;
 
     /* Start with an empty list. */
     head = NULL;
+    tail = NULL;
+
+    slabs = 0;
+    memory = 0;
 
     /* Request one slab from the pool at a time. */
     for (;;) {
-        next = twist__pool_alloc(bufr->pool);
+        want = (cap > bufr->size ? cap : bufr->size);
+        if (want > BUFFER_SLAB_SIZE)
+            want = BUFFER_SLAB_SIZE;
+
+        size = twist__pool_size(sizeof(struct twist__buffer_slab) + want);
+
+        next = twist__pool_alloc(bufr->pool, size);
         if (next == NULL)
             goto err;
 
-        /* Initialize the empty slab and prepend it to the linked list. */
+        /* Initialize the empty slab and append it to the linked list. Since
+         * slabs differ in size, the order matters. */
         next->start = ((uint8_t *) next) + sizeof(struct twist__buffer_slab);
         next->end = next->start;
+        next->limit = ((uint8_t *) next) + size;
+        next->next = NULL;
 
-        next->next = head;
-        head = next;
+        if (tail != NULL) {
+            tail->next = next;
+        } else {
+            head = next;
+        }
+
+        tail = next;
+
+        slabs++;
+        memory += size;
 
         /* Stop if this was the last slab we needed. */
-        if (cap <= BUFFER_SLAB_SIZE)
+        if (cap <= UNUSED(next))
             break;
 
-        cap -= BUFFER_SLAB_SIZE;
+        cap -= UNUSED(next);
     }
 
+    /* The caller is expected to link in all of the slabs. */
+    bufr->slabs += slabs;
+    bufr->memory += memory;
+
     return head;
 
     /* If we get here, an allocation failed. This means that `head` is the
@@ -227,3 +600,51 @@ static size_t append(struct twist__buffer_slab * slab, const uint8_t * buf, size
 
     return n;
 }
+
+
+/* Move the start of the head slab `n` bytes forward, discarding the slab if
+ * that empties it. */
+static void advance(struct twist__buffer * bufr, size_t n) {
+    struct twist__buffer_slab * slab = bufr->head;
+
+    slab->start += n;
+    bufr->size -= n;
+
+    if (bufr->size <= bufr->low)
+        bufr->blocked = 0;
+
+    if (slab->start == slab->end) {
+        bufr->slabs--;
+        bufr->memory -= OBJSIZE(slab);
+
+        if (slab->next != NULL) {
+            bufr->head = slab->next;
+        } else {
+            bufr->head = NULL;
+            bufr->tail = NULL;
+        }
+
+        twist__pool_free(bufr->pool, slab);
+    }
+}
+
+
+/* Decrypt up to `len` bytes of data into a slab. */
+static size_t append_xor(struct twist__buffer_slab * slab, struct nectar_chacha20_ctx * chacha,
+                         const uint8_t * src, size_t len) {
+    size_t n = UNUSED(slab);
+    if (n > len)
+        n = len;
+
+    nectar_chacha20_xor(chacha, slab->end, src, n);
+    slab->end += n;
+
+    return n;
+}
+
+
+/* Get the number of bytes that may be written before the buffer reaches its
+ * high water mark. */
+static size_t room(struct twist__buffer * bufr) {
+    return (bufr->size < bufr->high ? bufr->high - bufr->size : 0);
+}
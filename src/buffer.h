@@ -15,6 +15,10 @@
 #ifndef LIBTWIST_BUFFER_H
 #define LIBTWIST_BUFFER_H
 
+#include <sys/uio.h>
+
+#include <nectar.h>
+
 #include "include/twist.h"
 #include "src/pool.h"
 
@@ -26,6 +30,10 @@ struct twist__buffer_slab {
     uint8_t * start;
     uint8_t * end;
 
+    /* End of the slab's memory. Slabs come in different sizes, depending on
+     * how much data the buffer held when they were allocated. */
+    uint8_t * limit;
+
     /* Intrusive list pointer. */
     struct twist__buffer_slab * next;
 };
@@ -41,6 +49,19 @@ struct twist__buffer {
     /* Number of bytes currently stored in the buffer. */
     size_t size;
 
+    /* Number of slabs in the list, and their total size in bytes (including
+     * headers and unused space). */
+    size_t slabs;
+    size_t memory;
+
+    /* High and low water marks. Writes are cut short once the buffer holds
+     * `high` bytes, which sets the `blocked` flag; it's cleared again once
+     * the buffer has drained down to `low` bytes. Both are SIZE_MAX unless
+     * set with `twist__buffer_limit`. */
+    size_t high;
+    size_t low;
+    int blocked;
+
     /* Assigned memory pool. */
     struct twist__pool * pool;
 };
@@ -52,18 +73,84 @@ void twist__buffer_init(struct twist__buffer * bufr, struct twist__pool * pool);
 /* Discard all data and return the buffer's slabs to the object pool. */
 void twist__buffer_clear(struct twist__buffer * bufr);
 
+/* Set the buffer's high and low water marks. */
+void twist__buffer_limit(struct twist__buffer * bufr, size_t high, size_t low);
+
 /* Write a chunk of data to the buffer. Unless a necessary memory allocation
  * fails (in which case no data is written and TWIST_ENOMEM is returned), the
- * full write is guaranteed to complete successfully. The `len` argument must
- * not be greater than SSIZE_MAX. */
+ * write is guaranteed to complete successfully up to the high water mark.
+ * Fails with TWIST_EAGAIN if the buffer is already at its high water mark.
+ * The `len` argument must not be greater than SSIZE_MAX. */
 ssize_t twist__buffer_write(struct twist__buffer * bufr, const uint8_t * buf, size_t len);
 
+/* Decrypt a chunk of ciphertext straight into the buffer's free space, by
+ * XORing it with the key stream produced by `chacha`. This is equivalent to
+ * decrypting into a temporary buffer and calling `twist__buffer_write`, but
+ * saves a copy. The same failure guarantees apply, except that the water
+ * marks are ignored; received data is bounded by flow control instead.
+ * Since the plaintext becomes readable immediately, the ciphertext should be
+ * authenticated first. */
+ssize_t twist__buffer_decrypt(struct twist__buffer * bufr, struct nectar_chacha20_ctx * chacha,
+                              const uint8_t * src, size_t len);
+
+/* Get a pointer to at least `min_len` bytes of contiguous free space at the
+ * end of the buffer, which the caller can write into directly before calling
+ * `twist__buffer_commit`. The space is described by `iov`, whose length may
+ * be larger than `min_len`. Fails with TWIST_EINVAL if `min_len` is larger
+ * than the largest slab, TWIST_EAGAIN if the buffer is at its high water mark,
+ * or TWIST_ENOMEM if a new slab couldn't be allocated. */
+int twist__buffer_reserve(struct twist__buffer * bufr, size_t min_len, struct iovec * iov);
+
+/* Append `len` bytes, written into the space returned by the most recent
+ * `twist__buffer_reserve` call, to the buffer's data. Fails with TWIST_EINVAL
+ * if `len` is larger than the reserved space. */
+int twist__buffer_commit(struct twist__buffer * bufr, size_t len);
+
+
 /* Read data from the buffer. This call can't fail, only return 0 when the
  * buffer is empty. The `len` argument must not be greater than SSIZE_MAX. */
 ssize_t twist__buffer_read(struct twist__buffer * bufr, uint8_t * buf, size_t len);
 
+/* Fill in up to `count` iovecs describing the data at the front of the
+ * buffer, without copying or consuming it. Returns the number of iovecs used,
+ * which is 0 only if the buffer is empty. The iovecs remain valid until data
+ * is consumed from the buffer, or it is cleared. */
+size_t twist__buffer_peek(struct twist__buffer * bufr, struct iovec * iov, size_t count);
+
+/* Like `twist__buffer_peek`, but describes at most `len` bytes of data
+ * starting `offset` bytes into the buffer. This is how retransmissions find
+ * unacknowledged data, which stays in the write buffer until it has been
+ * delivered. */
+size_t twist__buffer_peek_at(struct twist__buffer * bufr, size_t offset, size_t len,
+                             struct iovec * iov, size_t count);
+
+/* Discard up to `len` bytes from the front of the buffer, returning emptied
+ * slabs to the object pool. Returns the number of bytes discarded. */
+size_t twist__buffer_consume(struct twist__buffer * bufr, size_t len);
+
+/* Move up to `len` bytes from the front of `src` to the end of `dst`. When
+ * both buffers share the same object pool, full slabs are moved between the
+ * buffers' lists rather than copied, so only partially consumed slabs at
+ * either end cost a copy. No more data is moved than `dst`'s high water mark
+ * allows. Returns the number of bytes moved, TWIST_EAGAIN if `dst` is already
+ * at its high water mark, or TWIST_ENOMEM if nothing could be moved because
+ * an allocation failed. */
+ssize_t twist__buffer_splice(struct twist__buffer * dst, struct twist__buffer * src, size_t len);
+
+
 /* Get the number of bytes of data currently stored in the buffer. */
 size_t twist__buffer_size(struct twist__buffer * bufr);
 
+/* Returns a non-zero value if the buffer will accept more data. Once a write
+ * has hit the high water mark, this stays zero until the buffer has drained
+ * down to its low water mark. */
+int twist__buffer_writable(struct twist__buffer * bufr);
+
+/* Get the number of slabs held by the buffer. */
+size_t twist__buffer_slabs(struct twist__buffer * bufr);
+
+/* Get the number of bytes of memory held by the buffer's slabs. */
+size_t twist__buffer_memory(struct twist__buffer * bufr);
+
 
 #endif
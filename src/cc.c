@@ -0,0 +1,163 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include "src/cc.h"
+
+
+/* How long a minimum RTT sample is trusted, in nanoseconds. */
+#define MIN_RTT_LIFETIME  ((int64_t) 10000000000)
+
+
+/* Static functions. */
+static void reno_init(struct twist__cc * cc, int64_t now);
+static void reno_on_ack(struct twist__cc * cc, size_t acked, size_t inflight, int64_t now);
+static void reno_on_loss(struct twist__cc * cc, size_t inflight, int64_t now);
+static uint64_t reno_pacing_rate(struct twist__cc * cc);
+
+
+/* NewReno. */
+const struct twist__cc_ops twist__reno_ops = {
+    reno_init,
+    reno_on_ack,
+    reno_on_loss,
+    reno_pacing_rate
+};
+
+
+/* Initialize a congestion controller using one of the TWIST_CC_* algorithms
+ * and a maximum segment size of `mss` bytes. Returns TWIST_EINVAL if the
+ * algorithm is unknown. */
+int twist__cc_init(struct twist__cc * cc, int type, size_t mss, int64_t now) {
+    switch (type) {
+    case TWIST_CC_CUBIC:
+        cc->ops = &twist__cubic_ops;
+        break;
+    case TWIST_CC_RENO:
+        cc->ops = &twist__reno_ops;
+        break;
+    case TWIST_CC_BBR:
+        cc->ops = &twist__bbr_ops;
+        break;
+    default:
+        return TWIST_EINVAL;
+    }
+
+    cc->type = type;
+    cc->mss = mss;
+    cc->cwnd = CC_INITIAL_WINDOW * mss;
+    cc->ssthresh = SIZE_MAX;
+    cc->srtt = 0;
+    cc->min_rtt = 0;
+    cc->min_rtt_stamp = 0;
+    cc->min_rtt_expired = 0;
+    cc->recovery = 0;
+
+    cc->ops->init(cc, now);
+
+    return TWIST_OK;
+}
+
+
+/* Feed a round trip time sample to the controller. */
+void twist__cc_on_rtt_sample(struct twist__cc * cc, int64_t rtt, int64_t now) {
+    if (rtt <= 0)
+        return;
+
+    /* Standard exponentially weighted moving average, with a gain of 1/8. */
+    if (cc->srtt == 0) {
+        cc->srtt = rtt;
+    } else {
+        cc->srtt += (rtt - cc->srtt) / 8;
+    }
+
+    /* The minimum expires after a while, so path changes are noticed. Whether
+     * it expired has to be worked out before the sample refreshes it. */
+    if (cc->min_rtt == 0 || rtt <= cc->min_rtt) {
+        cc->min_rtt = rtt;
+        cc->min_rtt_stamp = now;
+    } else if (now - cc->min_rtt_stamp > MIN_RTT_LIFETIME) {
+        cc->min_rtt = rtt;
+        cc->min_rtt_stamp = now;
+        cc->min_rtt_expired = 1;
+    }
+}
+
+
+/* Get a pacing rate derived from the congestion window: twice the window per
+ * smoothed RTT during slow start, and 1.25 times the window otherwise, like
+ * Linux uses for loss-based algorithms. */
+uint64_t twist__cc_window_rate(struct twist__cc * cc) {
+    uint64_t rate;
+    int64_t us;
+
+    us = cc->srtt / 1000;
+    if (us <= 0)
+        return 0;
+
+    rate = (uint64_t) cc->cwnd * 1000000 / (uint64_t) us;
+
+    if (cc->cwnd < cc->ssthresh)
+        return 2 * rate;
+    else
+        return rate + rate / 4;
+}
+
+
+/* Reset NewReno's state. */
+static void reno_init(struct twist__cc * cc, int64_t now) {
+    (void) now;
+    cc->u.reno.acked = 0;
+}
+
+
+/* Grow the window by the amount acknowledged during slow start, and by one
+ * segment per window acknowledged during congestion avoidance. */
+static void reno_on_ack(struct twist__cc * cc, size_t acked, size_t inflight, int64_t now) {
+    struct twist__reno * reno = &cc->u.reno;
+
+    (void) inflight;
+    (void) now;
+
+    if (cc->cwnd < cc->ssthresh) {
+        cc->cwnd += acked;
+        return;
+    }
+
+    reno->acked += acked;
+
+    if (reno->acked >= cc->cwnd) {
+        reno->acked -= cc->cwnd;
+        cc->cwnd += cc->mss;
+    }
+}
+
+
+/* Halve the window. */
+static void reno_on_loss(struct twist__cc * cc, size_t inflight, int64_t now) {
+    (void) inflight;
+    (void) now;
+
+    cc->cwnd /= 2;
+    if (cc->cwnd < CC_MIN_WINDOW * cc->mss)
+        cc->cwnd = CC_MIN_WINDOW * cc->mss;
+
+    cc->ssthresh = cc->cwnd;
+    cc->u.reno.acked = 0;
+}
+
+
+/* Pace according to the window. */
+static uint64_t reno_pacing_rate(struct twist__cc * cc) {
+    return twist__cc_window_rate(cc);
+}
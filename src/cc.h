@@ -0,0 +1,195 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#ifndef LIBTWIST_CC_H
+#define LIBTWIST_CC_H
+
+#include "include/twist.h"
+
+
+/* Initial and minimum congestion windows, in segments. */
+#define CC_INITIAL_WINDOW  10
+#define CC_MIN_WINDOW      2
+
+/* Number of slots in BBR's windowed maximum bandwidth filter, in rounds. */
+#define BBR_BW_SLOTS  10
+
+
+/* Per-algorithm state. */
+struct twist__reno {
+    /* Bytes acknowledged since the window last grew by a segment during
+     * congestion avoidance. */
+    size_t acked;
+};
+
+struct twist__cubic {
+    /* Window size just before the last reduction, and the window size the
+     * current cubic curve is centered on. */
+    size_t w_max;
+    size_t origin;
+
+    /* Estimate of the window a Reno flow would have, which CUBIC never falls
+     * behind ("TCP-friendly region"). */
+    size_t w_est;
+
+    /* Start of the current congestion avoidance epoch (0 if none), and time
+     * it takes the curve to reach `origin`, in milliseconds. */
+    int64_t epoch;
+    int64_t k;
+};
+
+struct twist__bbr {
+    /* Current state: one of the BBR_* constants in bbr.c. */
+    int state;
+
+    /* Windowed maximum of delivery rate samples, in bytes per second, one per
+     * round, and the index of the current round. */
+    uint64_t bw[BBR_BW_SLOTS];
+    uint64_t round;
+
+    /* Bytes delivered during the current round, and when it started. */
+    size_t delivered;
+    int64_t round_start;
+
+    /* Startup exit detection: the bandwidth to beat, and the number of rounds
+     * it hasn't been beaten by 25%. */
+    uint64_t full_bw;
+    unsigned int full_rounds;
+
+    /* Position in the PROBE_BW gain cycle. */
+    unsigned int cycle;
+
+    /* When the current PROBE_RTT phase ends, or when the next one is due. */
+    int64_t probe_rtt_done;
+    int64_t probe_rtt_due;
+
+    /* Upper bound on the amount of data in flight, lowered on loss and slowly
+     * raised again while probing for bandwidth (as in BBRv2). */
+    size_t inflight_hi;
+};
+
+
+struct twist__cc;
+
+
+/* Congestion control implementations are tables of the following functions,
+ * which are called through the `twist__cc_*` functions below. */
+struct twist__cc_ops {
+    /* Reset the algorithm's state. The common fields have already been
+     * initialized. */
+    void (*init)(struct twist__cc * cc, int64_t now);
+
+    /* React to `acked` bytes being newly acknowledged, leaving `inflight`
+     * bytes still unacknowledged. */
+    void (*on_ack)(struct twist__cc * cc, size_t acked, size_t inflight, int64_t now);
+
+    /* React to a congestion event. */
+    void (*on_loss)(struct twist__cc * cc, size_t inflight, int64_t now);
+
+    /* Get the rate at which packets should be paced out, in bytes per second,
+     * or 0 if packets shouldn't be paced. */
+    uint64_t (*pacing_rate)(struct twist__cc * cc);
+};
+
+
+/* Congestion controller state, hung off every connection. */
+struct twist__cc {
+    /* Either TWIST_CC_CUBIC, TWIST_CC_RENO or TWIST_CC_BBR, and the matching
+     * implementation. */
+    int type;
+    const struct twist__cc_ops * ops;
+
+    /* Maximum segment size, congestion window and slow start threshold, all
+     * in bytes. */
+    size_t mss;
+    size_t cwnd;
+    size_t ssthresh;
+
+    /* Smoothed and minimum round trip times, and when the minimum was last
+     * measured. All are 0 until the first sample. */
+    int64_t srtt;
+    int64_t min_rtt;
+    int64_t min_rtt_stamp;
+
+    /* Set when the minimum RTT was last replaced because it had expired,
+     * rather than because a lower sample came in. BBR clears it when it
+     * reacts by probing for the minimum. */
+    int min_rtt_expired;
+
+    /* Time the current recovery episode started. Losses of packets sent
+     * before that time don't reduce the window again. */
+    int64_t recovery;
+
+    /* Algorithm-specific state. */
+    union {
+        struct twist__reno reno;
+        struct twist__cubic cubic;
+        struct twist__bbr bbr;
+    } u;
+};
+
+
+/* Implementations. */
+extern const struct twist__cc_ops twist__reno_ops;
+extern const struct twist__cc_ops twist__cubic_ops;
+extern const struct twist__cc_ops twist__bbr_ops;
+
+
+/* Initialize a congestion controller using one of the TWIST_CC_* algorithms
+ * and a maximum segment size of `mss` bytes. Returns TWIST_EINVAL if the
+ * algorithm is unknown. */
+int twist__cc_init(struct twist__cc * cc, int type, size_t mss, int64_t now);
+
+/* Feed a round trip time sample to the controller. */
+void twist__cc_on_rtt_sample(struct twist__cc * cc, int64_t rtt, int64_t now);
+
+/* Get a pacing rate derived from the congestion window and smoothed RTT, for
+ * use by window-based algorithms. */
+uint64_t twist__cc_window_rate(struct twist__cc * cc);
+
+
+/* React to `acked` bytes being newly acknowledged. */
+static inline void twist__cc_on_ack(struct twist__cc * cc, size_t acked,
+                                    size_t inflight, int64_t now) {
+    cc->ops->on_ack(cc, acked, inflight, now);
+}
+
+
+/* React to the loss of a packet sent at `sent`. Only the first loss in each
+ * round trip is treated as a congestion event. */
+static inline void twist__cc_on_loss(struct twist__cc * cc, int64_t sent,
+                                     size_t inflight, int64_t now) {
+    if (sent < cc->recovery)
+        return;
+
+    cc->recovery = now;
+    cc->ops->on_loss(cc, inflight, now);
+}
+
+
+/* Returns a non-zero value if another segment may be sent with `inflight`
+ * bytes unacknowledged. */
+static inline int twist__cc_can_send(struct twist__cc * cc, size_t inflight) {
+    return (inflight < cc->cwnd);
+}
+
+
+/* Get the rate at which packets should be paced out, in bytes per second, or
+ * 0 if packets shouldn't be paced. */
+static inline uint64_t twist__cc_pacing_rate(struct twist__cc * cc) {
+    return cc->ops->pacing_rate(cc);
+}
+
+
+#endif
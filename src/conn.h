@@ -16,11 +16,21 @@
 #define LIBTWIST_CONN_H
 
 #include "include/twist.h"
+#include "src/ack.h"
 #include "src/buffer.h"
+#include "src/cc.h"
+#include "src/pacer.h"
 #include "src/packet.h"
+#include "src/sent.h"
+#include "src/window.h"
 
 
-/* Connection state. */
+/* Connection state.
+ *
+ * The protocol state machine (conn.c) isn't part of this tree yet. The flow
+ * control, congestion control, pacing, acknowledgement and sent packet
+ * modules below are complete but standalone: their comments describe how
+ * the state machine is expected to drive them once it lands. */
 struct twist__conn {
     /* Owning socket. */
     struct twist__sock * sock;
@@ -28,7 +38,10 @@ struct twist__conn {
     /* Connection state. */
     int state;
 
-    /* When is the next time-based event scheduled to occur?
+    /* When is the next time-based event scheduled to occur? This is meant
+     * to be the earliest of the connection's protocol timers and, while it
+     * has data held back by `pacer`, the time the next packet may be
+     * released.
      * NOTE: Managed in conn.c, but used by sock.c and heap.c. */
     int64_t next_tick;
 
@@ -36,23 +49,69 @@ struct twist__conn {
     uint64_t local_cookie;
     uint64_t remote_cookie;
 
-    /* Buffers for outgoing and incoming data. */
-    struct twist__buffer write_buffer;
-    struct twist__buffer read_buffer;
-
     /* Current position in the socket's min-heap.
      * NOTE: Managed in heap.c. */
     uint32_t heap_index;
 
-    /* Intrusive pointer for hash table chaining.
-     * NOTE: Managed in dict.c. */
-    struct twist__conn * chain;
+    /* Current slot and intrusive list pointers, used instead of `heap_index`
+     * when the socket schedules timers using a timing wheel.
+     * These are kept next to `next_tick`, so rescheduling a connection
+     * touches as few cache lines as possible.
+     * NOTE: Managed in wheel.c. */
+    uint32_t wheel_slot;
+    struct twist__conn * wheel_prev;
+    struct twist__conn * wheel_next;
+
+    /* Buffers for outgoing and incoming data. The write buffer's water marks
+     * are to be initialized from the socket's `send_high` and `send_low`
+     * settings, so `twist_write` pushes back on producers that outpace the
+     * network. */
+    struct twist__buffer write_buffer;
+    struct twist__buffer read_buffer;
+
+    /* Congestion controller for the socket's `cc` setting. The connection
+     * should only send while `twist__cc_can_send` allows it, and feed the
+     * controller with ACKs, losses and RTT samples. */
+    struct twist__cc cc;
+
+    /* Acknowledgement scheduler for received packets, configured by the
+     * socket's `ack_frequency` and `ack_delay` settings. Pending ACKs are
+     * meant to be piggybacked on outgoing data, with `twist__ack_deadline`
+     * folded into `next_tick` so standalone ACKs go out on time. */
+    struct twist__ack ack;
+
+    /* Tracker for packets in flight. Sent data stays in `write_buffer`,
+     * whose front is consumed as `sent.delivered` advances; retransmissions
+     * are read back with `twist__buffer_peek_at`, and the RACK and probe
+     * timers from `twist__sent_timeout` are folded into `next_tick`. */
+    struct twist__sent sent;
+
+    /* Pacer for releasing packets at `twist__cc_pacing_rate`, sized by the
+     * socket's `pacing_burst` setting. `twist__pacer_next` is folded into
+     * `next_tick`, so `handle_tick` wakes the connection when a held back
+     * packet may go out. */
+    struct twist__pacer pacer;
+
+    /* Flow control state, sized from the socket's `recv_window` settings.
+     * Data beyond the advertised receive window is to be discarded rather
+     * than appended to `read_buffer`, and outgoing data held back once the
+     * peer's window is exhausted. */
+    struct twist__window window;
 
     /* Intrusive pointers for storing the connection in its socket's linked
      * list of pending accepted connections.
      * NOTE: Managed in sock.c. */
     struct twist__conn * prev;
     struct twist__conn * next;
+
+    /* Pending readiness events, and intrusive pointers for storing the
+     * connection in its socket's circular list of connections with pending
+     * events. The state machine reports events with `twist__sock_notify`,
+     * e.g. TWIST_WRITABLE once `twist__buffer_writable` turns true again.
+     * NOTE: Managed in sock.c. */
+    unsigned int events;
+    struct twist__conn * ready_prev;
+    struct twist__conn * ready_next;
 };
 
 
@@ -78,7 +137,12 @@ int twist__conn_accept(struct twist__conn * conn,
 /* Propagate a time event to the connection's state machine. */
 int twist__conn_tick(struct twist__conn * conn, int64_t now);
 
-/* Feed a received packet to the connection's state machine. */
+/* Feed a received packet to the connection's state machine. The packet is
+ * borrowed (see `twist__packet_wrap`): its payload points into the caller's
+ * buffer, and is only valid until this function returns. Connections that
+ * need to hold on to a packet must copy it with `twist__packet_copy`, and
+ * should otherwise decrypt the payload straight into their read buffers using
+ * `twist__buffer_decrypt`. */
 int twist__conn_recv(struct twist__conn * conn, char type,
                      struct twist__packet * packet, int64_t now);
 
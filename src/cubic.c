@@ -0,0 +1,182 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include "src/cc.h"
+
+
+/* Multiplicative decrease factor (beta = 0.7), as a fraction. */
+#define BETA_NUM  7
+#define BETA_DEN  10
+
+/* Largest distance from the curve's inflection point considered, in
+ * milliseconds, which keeps the cubed value from overflowing. */
+#define MAX_OFFSET  (1 << 17)
+
+
+/* Static functions. */
+static void cubic_init(struct twist__cc * cc, int64_t now);
+static void cubic_on_ack(struct twist__cc * cc, size_t acked, size_t inflight, int64_t now);
+static void cubic_on_loss(struct twist__cc * cc, size_t inflight, int64_t now);
+static uint64_t cubic_pacing_rate(struct twist__cc * cc);
+static size_t curve(struct twist__cc * cc, int64_t now);
+static uint64_t cbrt64(uint64_t x);
+
+
+/* CUBIC, as specified by RFC 8312, without HyStart. */
+const struct twist__cc_ops twist__cubic_ops = {
+    cubic_init,
+    cubic_on_ack,
+    cubic_on_loss,
+    cubic_pacing_rate
+};
+
+
+/* Reset CUBIC's state. */
+static void cubic_init(struct twist__cc * cc, int64_t now) {
+    struct twist__cubic * cubic = &cc->u.cubic;
+
+    (void) now;
+
+    cubic->w_max = 0;
+    cubic->origin = 0;
+    cubic->w_est = 0;
+    cubic->epoch = 0;
+    cubic->k = 0;
+}
+
+
+/* Grow the window along the cubic curve, or as fast as Reno would if that's
+ * faster. */
+static void cubic_on_ack(struct twist__cc * cc, size_t acked, size_t inflight, int64_t now) {
+    struct twist__cubic * cubic = &cc->u.cubic;
+    size_t target, inc;
+
+    (void) inflight;
+
+    /* Slow start is the same as Reno's. */
+    if (cc->cwnd < cc->ssthresh) {
+        cc->cwnd += acked;
+        return;
+    }
+
+    /* Start a new epoch on the first ACK after a reduction. */
+    if (cubic->epoch == 0) {
+        cubic->epoch = now;
+        cubic->w_est = cc->cwnd;
+
+        if (cc->cwnd < cubic->w_max) {
+            /* K = cbrt((w_max - cwnd) / C), with C = 0.4 segments/s^3, which
+             * works out to 2.5e9 ms^3 per segment. */
+            cubic->k = (int64_t) cbrt64((uint64_t) (cubic->w_max - cc->cwnd) * 2500 / cc->mss * 1000000);
+            cubic->origin = cubic->w_max;
+        } else {
+            cubic->k = 0;
+            cubic->origin = cc->cwnd;
+        }
+    }
+
+    /* A Reno flow would grow by 3 * (1 - beta) / (1 + beta) = 9/17 segments
+     * per RTT in the same circumstances. */
+    cubic->w_est += (size_t) ((uint64_t) acked * cc->mss * 9 / (17 * (uint64_t) cc->cwnd));
+
+    target = curve(cc, now);
+    if (target < cubic->w_est)
+        target = cubic->w_est;
+
+    /* Close the gap to the target over the course of one window, but never
+     * grow by more than half of what was acknowledged. */
+    if (target > cc->cwnd) {
+        inc = (size_t) ((uint64_t) (target - cc->cwnd) * acked / cc->cwnd);
+        if (inc > acked / 2)
+            inc = acked / 2;
+
+        cc->cwnd += inc;
+    }
+}
+
+
+/* Reduce the window by 30%, remembering where the reduction happened. */
+static void cubic_on_loss(struct twist__cc * cc, size_t inflight, int64_t now) {
+    struct twist__cubic * cubic = &cc->u.cubic;
+
+    (void) inflight;
+    (void) now;
+
+    /* Fast convergence: if the window didn't recover to its previous maximum,
+     * another flow is probably competing for the bandwidth, so yield some. */
+    if (cc->cwnd < cubic->w_max)
+        cubic->w_max = cc->cwnd * (BETA_DEN + BETA_NUM) / (2 * BETA_DEN);
+    else
+        cubic->w_max = cc->cwnd;
+
+    cc->cwnd = cc->cwnd / BETA_DEN * BETA_NUM;
+    if (cc->cwnd < CC_MIN_WINDOW * cc->mss)
+        cc->cwnd = CC_MIN_WINDOW * cc->mss;
+
+    cc->ssthresh = cc->cwnd;
+    cubic->epoch = 0;
+}
+
+
+/* Pace according to the window. */
+static uint64_t cubic_pacing_rate(struct twist__cc * cc) {
+    return twist__cc_window_rate(cc);
+}
+
+
+/* Evaluate W(t) = C * (t - K)^3 + origin one RTT from now, in bytes. */
+static size_t curve(struct twist__cc * cc, int64_t now) {
+    struct twist__cubic * cubic = &cc->u.cubic;
+    uint64_t offset;
+    int64_t t;
+
+    t = (now - cubic->epoch + cc->min_rtt) / 1000000 - cubic->k;
+    if (t > MAX_OFFSET)
+        t = MAX_OFFSET;
+    else if (t < -MAX_OFFSET)
+        t = -MAX_OFFSET;
+
+    /* C * |t|^3 in segments is 4 * |t|^3 / 1e10, with `t` in milliseconds.
+     * Dividing by 1000 first leaves room for the multiplication by `mss`. */
+    offset = (uint64_t) (t < 0 ? -t : t);
+    offset = offset * offset * offset / 1000 * 4 * cc->mss / 10000000;
+
+    if (t >= 0)
+        return cubic->origin + (size_t) offset;
+    else if (offset < cubic->origin)
+        return cubic->origin - (size_t) offset;
+    else
+        return 0;
+}
+
+
+/* Compute the integer cube root of a 64-bit integer, one bit at a time. */
+static uint64_t cbrt64(uint64_t x) {
+    uint64_t y, b;
+    int s;
+
+    y = 0;
+
+    for (s = 63; s >= 0; s -= 3) {
+        y <<= 1;
+        b = 3 * y * (y + 1) + 1;
+
+        if ((x >> s) >= b) {
+            x -= b << s;
+            y++;
+        }
+    }
+
+    return y;
+}
@@ -12,47 +12,67 @@
  * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
  * PERFORMANCE OF THIS SOFTWARE. */
 
+
+#include <string.h>
+
 #include <nectar.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "src/dict.h"
+#include "src/endian.h"
 #include "src/mem.h"
 
 
+/* Number of slots per group. */
+#define GROUP_SIZE  16
+
+
+/* Special control byte values. Both have the most significant bit set, which
+ * can never be the case for a hash fragment. */
+#define EMPTY    0x80
+#define DELETED  0xfe
+
+
 /* Minimum (default) and maximum hash table sizes. The maximum size may seem
  * arbitrary, but it's the highest we can go while being sure multiplication
- * by 8 (size of 64-bit pointers) won't overflow uint32_t. */
+ * by 17 (size of a slot and its control byte) won't overflow uint32_t. */
 #define MIN_TABLE_SIZE  (1 << 6)
-#define MAX_TABLE_SIZE  (1 << 28)
+#define MAX_TABLE_SIZE  (1 << 27)
 
 
 /* Static functions. */
 static int maybe_resize(struct twist__dict * dict);
-static void migrate_bucket(struct twist__dict * dict, uint32_t index);
-static void migrate_buckets(struct twist__dict * dict, int num);
-static uint32_t locate_bucket(struct twist__dict * dict, uint64_t cookie,
-                              struct twist__dict_table ** table);
+static void migrate_slot(struct twist__dict * dict, uint32_t index);
+static void migrate_slots(struct twist__dict * dict, int num);
 
+static int table_init(struct twist__dict * dict, struct twist__dict_table * table, uint32_t size);
+static void table_clear(struct twist__dict * dict, struct twist__dict_table * table);
+static struct twist__dict_slot * table_find(struct twist__dict_table * table,
+                                            uint64_t cookie, uint64_t hash);
+static void table_insert(struct twist__dict_table * table, struct twist__conn * conn, uint64_t hash);
+static int table_remove(struct twist__dict_table * table, uint64_t cookie, uint64_t hash);
 
-/* Initialize a dict instance. The call returns zero or success, or
+static uint32_t match(const uint8_t * group, uint8_t value);
+static uint32_t match_free(const uint8_t * group);
+static unsigned int lowest(uint32_t x);
+static uint64_t hash(struct twist__dict * dict, uint64_t cookie);
+
+
+/* Initialize a dict instance, using either TWIST_HASH_FAST or
+ * TWIST_HASH_SIPHASH to hash cookies. The call returns zero or success, or
  * TWIST_ENOMEM if a necessary allocation failed. */
-int twist__dict_init(struct twist__dict * dict, uint8_t seed[16]) {
-    struct twist__conn ** buckets;
+int twist__dict_init(struct twist__dict * dict, uint8_t seed[16], int hash,
+                     struct twist__mem * mem) {
     int i;
 
-    /* Allocate the initial array of hash buckets. */
-    buckets = twist__malloc(MIN_TABLE_SIZE * sizeof(struct twist__conn *));
-    if (buckets == NULL)
-        return TWIST_ENOMEM;
-
-    for (i = 0; i < MIN_TABLE_SIZE; i++)
-        buckets[i] = NULL;
+    dict->mem = mem;
 
-    /* Initialize the dict instance. */
-    dict->tables[0] = (struct twist__dict_table) {
-        .buckets = buckets,
-        .size = MIN_TABLE_SIZE,
-        .mask = MIN_TABLE_SIZE - 1,
-    };
+    /* Allocate the initial hash table. */
+    if (table_init(dict, &dict->tables[0], MIN_TABLE_SIZE) != TWIST_OK)
+        return TWIST_ENOMEM;
 
     dict->split = 0;
     dict->count = 0;
@@ -61,39 +81,45 @@ int twist__dict_init(struct twist__dict * dict, uint8_t seed[16]) {
     for (i = 0; i < 16; i++)
         dict->seed[i] = seed[i];
 
+    dict->hash = hash;
+    dict->keys[0] = be64dec(seed);
+    dict->keys[1] = be64dec(seed + 8);
+
     return TWIST_OK;
 }
 
 
 /* Free the dict's internal hash table(s). */
 void twist__dict_clear(struct twist__dict * dict) {
-    twist__free(dict->tables[0].buckets);
+    table_clear(dict, &dict->tables[0]);
 
     /* If we've created a second hash table, free its storage too. */
     if (dict->split > 0)
-        twist__free(dict->tables[1].buckets);
+        table_clear(dict, &dict->tables[1]);
 }
 
 
 /* Look up a connection in the dict by its local connection cookie. The
  * returned pointer will be NULL if no matching entry could be found. */
 struct twist__conn * twist__dict_find(struct twist__dict * dict, uint64_t cookie) {
-    struct twist__dict_table * table;
-    struct twist__conn * conn;
-    uint32_t index;
+    struct twist__dict_slot * slot;
+    uint64_t key;
 
-    /* If we're resizing the underlying hash table, move some buckets. */
+    /* If we're resizing the underlying hash table, move some slots. */
     if (dict->split > 0)
-        migrate_buckets(dict, 1);
+        migrate_slots(dict, 1);
 
-    /* Search through all chained entries in the bucket. */
-    index = locate_bucket(dict, cookie, &table);
-    conn = table->buckets[index];
+    key = hash(dict, cookie);
 
-    while (conn != NULL && conn->local_cookie != cookie)
-        conn = conn->chain;
+    /* While resizing, entries may live in either of the two tables. */
+    slot = NULL;
 
-    return conn;
+    if (dict->split > 0)
+        slot = table_find(&dict->tables[1], cookie, key);
+    if (slot == NULL)
+        slot = table_find(&dict->tables[0], cookie, key);
+
+    return (slot != NULL ? slot->conn : NULL);
 }
 
 
@@ -104,28 +130,20 @@ struct twist__conn * twist__dict_find(struct twist__dict * dict, uint64_t cookie
  * The implementation makes the assumption that local connection cookies are
  * unique, and that the same connection won't be inserted twice. */
 int twist__dict_add(struct twist__dict * dict, struct twist__conn * conn) {
-    struct twist__dict_table * table;
-    struct twist__conn * head;
-    uint32_t index;
     int ret;
 
-    /* If we're resizing the underlying hash table, move some buckets.
+    /* If we're resizing the underlying hash table, move some slots.
      * Otherwise, see if the hash table needs resizing. */
     if (dict->split > 0) {
-        migrate_buckets(dict, 4);
+        migrate_slots(dict, 4);
     } else {
         ret = maybe_resize(dict);
         if (ret != TWIST_OK)
             return ret;
     }
 
-    /* Find the relevant hash table bucket. */
-    index = locate_bucket(dict, conn->local_cookie, &table);
-
-    /* Insert the connection at the head of the bucket. */
-    head = table->buckets[index];
-    conn->chain = head;
-    table->buckets[index] = conn;
+    /* New entries always go into the newest hash table. */
+    table_insert(&dict->tables[dict->split > 0 ? 1 : 0], conn, hash(dict, conn->local_cookie));
 
     /* Update the entry count. */
     dict->count++;
@@ -136,36 +154,21 @@ int twist__dict_add(struct twist__dict * dict, struct twist__conn * conn) {
 
 /* Remove a connection entry from the dict. */
 void twist__dict_remove(struct twist__dict * dict, struct twist__conn * conn) {
-    struct twist__dict_table * table;
-    struct twist__conn ** prev;
-    uint64_t cookie;
-    uint32_t index;
+    uint64_t cookie, key;
 
     /* Extract the cookie. */
     cookie = conn->local_cookie;
+    key = hash(dict, cookie);
 
-    /* Find the head of the relevant hash bucket. */
-    index = locate_bucket(dict, cookie, &table);
-    prev = &table->buckets[index];
-
-    while ((conn = *prev) != NULL) {
-        /* If we find a match, unlink it and stop. */
-        if (conn->local_cookie == cookie) {
-            *prev = conn->chain;
-            conn->chain = NULL;
-            dict->count--;
-            break;
-        }
-
-        /* We can only unlink the connection if we keep track of the
-         * previous pointer. */
-        prev = &conn->chain;
-    }
+    /* Remove the entry from whichever table it's stored in. */
+    if (table_remove(&dict->tables[0], cookie, key) ||
+        (dict->split > 0 && table_remove(&dict->tables[1], cookie, key)))
+        dict->count--;
 
-    /* If we're resizing the underlying hash table, move some buckets.
+    /* If we're resizing the underlying hash table, move some slots.
      * Otherwise, see if the underlying hash table needs resizing. */
     if (dict->split > 0) {
-        migrate_buckets(dict, 4);
+        migrate_slots(dict, 4);
     } else {
         /* TODO: While calls to `twist__dict_remove` must always succeed, there
          *       might be a better way to deal with this potential error? */
@@ -175,120 +178,271 @@ void twist__dict_remove(struct twist__dict * dict, struct twist__conn * conn) {
 
 
 /* Shrink or grow the dict's underlying hash table if utilization is too high
- * or too low. */
+ * or too low, or rebuild it if it has accumulated too many deleted slots. */
 static int maybe_resize(struct twist__dict * dict) {
-    struct twist__conn ** buckets;
     uint64_t count;
-    uint32_t size;
-    uint32_t i;
+    uint32_t size, used;
+    int ret;
 
     /* Make access to these variables slightly more ergonomic. */
     count = dict->count;
     size = dict->tables[0].size;
-
-    /* Resize the hash table if it contains as many entries as there are hash
-     * buckets, or if there are more than four times as many hash buckets as
-     * there are actual entries. */
-    if (count >= (uint64_t) size && size < MAX_TABLE_SIZE)
-        size <<= 1;
-    else if (count < (uint64_t) (size / 4) && size > MIN_TABLE_SIZE)
+    used = dict->tables[0].used;
+
+    /* Once 7/8 of all slots are either occupied or deleted, probe sequences
+     * start getting long. Double the table's size if at least half of the
+     * slots hold live entries, otherwise rebuild it at the same size to get
+     * rid of deleted slots. Shrink the table when less than 1/8 of its slots
+     * are in use. */
+    if (used >= size - size/8) {
+        if (count >= (uint64_t) (size / 2) && size < MAX_TABLE_SIZE)
+            size <<= 1;
+        else if (count >= (uint64_t) (size - size/8))
+            return TWIST_ENOMEM;
+    } else if (count < (uint64_t) (size / 8) && size > MIN_TABLE_SIZE) {
         size >>= 1;
-    else
+    } else {
         return TWIST_OK;
+    }
 
-    /* Allocate the underlying storage for our new hash table. */
-    buckets = twist__malloc(size * sizeof(struct twist__conn *));
-    if (buckets == NULL)
-        return TWIST_ENOMEM;
-
-    for (i = 0; i < size; i++)
-        buckets[i] = NULL;
-
-    /* Initialize the spare table. */
-    dict->tables[1] = (struct twist__dict_table) {
-        .buckets = buckets,
-        .size = size,
-        .mask = size - 1,
-    };
+    /* Allocate our new hash table. */
+    ret = table_init(dict, &dict->tables[1], size);
+    if (ret != TWIST_OK)
+        return ret;
 
-    /* Migrate the first bucket in the old hash table, solely so we can set
+    /* Migrate the first slot in the old hash table, solely so we can set
      * the `split` field to a non-zero value. */
-    migrate_bucket(dict, 0);
+    migrate_slot(dict, 0);
     dict->split = 1;
 
     return TWIST_OK;
 }
 
 
-/* Move all entries from a bucket in the current hash table to their new
- * positions in the new hash table. */
-static void migrate_bucket(struct twist__dict * dict, uint32_t index) {
-    struct twist__conn * conn, * next;
-    uint32_t key;
-
-    /* Grab the first entry, then clear the bucket. */
-    conn = dict->tables[0].buckets[index];
-    dict->tables[0].buckets[index] = NULL;
+/* Move the entry (if any) in a slot of the current hash table to its new
+ * position in the new hash table. */
+static void migrate_slot(struct twist__dict * dict, uint32_t index) {
+    struct twist__dict_table * table;
+    struct twist__conn * conn;
 
-    /* Move all entries in the original chain. */
-    while (conn != NULL) {
-        next = conn->chain;
+    table = &dict->tables[0];
 
-        /* Move the connection struct to its new home bucket. */
-        key = (uint32_t) nectar_siphash(dict->seed, (const uint8_t *) conn->local_cookie, 8);
-        index = key & dict->tables[1].mask;
+    /* Skip empty and deleted slots. */
+    if ((table->ctrl[index] & 0x80) != 0)
+        return;
 
-        conn->chain = dict->tables[1].buckets[index];
-        dict->tables[1].buckets[index] = conn;
+    conn = table->slots[index].conn;
+    table_insert(&dict->tables[1], conn, hash(dict, conn->local_cookie));
 
-        /* Move on to the next chained entry. */
-        conn = next;
-    }
+    /* Keep the old table's probe sequences intact by marking the slot as
+     * deleted rather than empty. */
+    table->ctrl[index] = DELETED;
 }
 
 
-/* Move `num` buckets from the current hash table to the next. This function
+/* Move `num` slots from the current hash table to the next. This function
  * allows us to amortize the cost of resizing hash tables over many read or
  * write operations. */
-static void migrate_buckets(struct twist__dict * dict, int num) {
+static void migrate_slots(struct twist__dict * dict, int num) {
     int i;
 
-    /* Move up to `num` buckets to the resized hash table. */
+    /* Move up to `num` slots to the resized hash table. */
     for (i = 0; i < num && dict->split > 0; i++) {
-        migrate_bucket(dict, dict->split);
+        migrate_slot(dict, dict->split);
 
         /* Update the split index. Because the hash table size is always a
          * power of two, the mask operation makes the increment wrap to zero
          * when we're done. */
-        dict->split = (dict->split + 1) & dict->tables[0].mask;
+        dict->split = (dict->split + 1) & (dict->tables[0].size - 1);
     }
 
-    /* Once all bucket entries have been moved, drop the old hash table. */
+    /* Once all entries have been moved, drop the old hash table. */
     if (dict->split == 0) {
-        twist__free(dict->tables[0].buckets);
+        table_clear(dict, &dict->tables[0]);
         dict->tables[0] = dict->tables[1];
     }
 }
 
 
-/* Determine which hash table bucket a particular connection cookie maps to.
- * The hash table's address will be stored in the `table` pointer. */
-static uint32_t locate_bucket(struct twist__dict * dict, uint64_t cookie,
-                              struct twist__dict_table ** table) {
-    uint32_t key, index;
+/* Allocate and initialize an empty hash table with `size` slots. */
+static int table_init(struct twist__dict * dict, struct twist__dict_table * table, uint32_t size) {
+    uint8_t * mem;
+
+    /* Allocate the slots and control bytes in one go. */
+    mem = twist__malloc(dict->mem, (size_t) size * (sizeof(struct twist__dict_slot) + 1));
+    if (mem == NULL)
+        return TWIST_ENOMEM;
+
+    table->slots = (struct twist__dict_slot *) mem;
+    table->ctrl = mem + (size_t) size * sizeof(struct twist__dict_slot);
+    table->size = size;
+    table->mask = size/GROUP_SIZE - 1;
+    table->used = 0;
+
+    memset(table->ctrl, EMPTY, size);
+
+    return TWIST_OK;
+}
+
+
+/* Free a hash table's storage. */
+static void table_clear(struct twist__dict * dict, struct twist__dict_table * table) {
+    twist__free(dict->mem, table->slots, (size_t) table->size * (sizeof(struct twist__dict_slot) + 1));
+}
+
 
-    /* Find the relevant bucket in the main hash table. */
-    key = (uint32_t) nectar_siphash(dict->seed, (const uint8_t *) cookie, 8);
-    index = key & dict->tables[0].mask;
+/* Find the slot holding a particular cookie, or NULL if there is none. */
+static struct twist__dict_slot * table_find(struct twist__dict_table * table,
+                                            uint64_t cookie, uint64_t hash) {
+    const uint8_t * ctrl;
+    uint32_t group, step, bits, index;
 
-    /* If we're in the process of moving to a new hash table, and our bucket
-     * has already been moved, look for the new bucket instead. */
-    if (index < dict->split) {
-        index = key & dict->tables[1].mask;
-        *table = &dict->tables[1];
+    group = (uint32_t) (hash >> 7) & table->mask;
+
+    /* Probe groups in triangular order, which visits every group exactly
+     * once when the number of groups is a power of two. */
+    for (step = 1; step <= table->mask + 1; step++) {
+        ctrl = table->ctrl + group * GROUP_SIZE;
+
+        /* Check each slot whose control byte matches the hash fragment. */
+        for (bits = match(ctrl, (uint8_t) (hash & 0x7f)); bits != 0; bits &= bits - 1) {
+            index = group * GROUP_SIZE + lowest(bits);
+            if (table->slots[index].cookie == cookie)
+                return &table->slots[index];
+        }
+
+        /* A group with empty slots ends the probe sequence, because the
+         * cookie would otherwise have been stored there. */
+        if (match(ctrl, EMPTY) != 0)
+            break;
+
+        group = (group + step) & table->mask;
+    }
+
+    return NULL;
+}
+
+
+/* Store a connection in the first free slot along its probe sequence. The
+ * caller must make sure that the table isn't full. */
+static void table_insert(struct twist__dict_table * table, struct twist__conn * conn, uint64_t hash) {
+    uint32_t group, step, bits, index;
+
+    group = (uint32_t) (hash >> 7) & table->mask;
+
+    for (step = 1; ; step++) {
+        bits = match_free(table->ctrl + group * GROUP_SIZE);
+        if (bits != 0)
+            break;
+
+        group = (group + step) & table->mask;
+    }
+
+    index = group * GROUP_SIZE + lowest(bits);
+
+    /* Deleted slots are already accounted for. */
+    if (table->ctrl[index] == EMPTY)
+        table->used++;
+
+    table->ctrl[index] = (uint8_t) (hash & 0x7f);
+    table->slots[index].cookie = conn->local_cookie;
+    table->slots[index].conn = conn;
+}
+
+
+/* Remove a cookie from the table. Returns a non-zero value if the cookie
+ * was found. */
+static int table_remove(struct twist__dict_table * table, uint64_t cookie, uint64_t hash) {
+    struct twist__dict_slot * slot;
+    uint32_t index;
+
+    slot = table_find(table, cookie, hash);
+    if (slot == NULL)
+        return 0;
+
+    index = (uint32_t) (slot - table->slots);
+
+    /* If the slot's group has empty slots, no probe sequence can have passed
+     * through it, which means it's safe to mark this slot as empty too. */
+    if (match(table->ctrl + (index & ~(uint32_t) (GROUP_SIZE - 1)), EMPTY) != 0) {
+        table->ctrl[index] = EMPTY;
+        table->used--;
     } else {
-        *table = &dict->tables[0];
+        table->ctrl[index] = DELETED;
+    }
+
+    return 1;
+}
+
+
+/* Get a bitmask of all slots in a group whose control bytes equal `value`. */
+static uint32_t match(const uint8_t * group, uint8_t value) {
+#if defined(__SSE2__)
+    __m128i ctrl = _mm_loadu_si128((const __m128i *) group);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char) value)));
+#else
+    uint32_t bits = 0;
+    int i;
+
+    for (i = 0; i < GROUP_SIZE; i++)
+        if (group[i] == value)
+            bits |= ((uint32_t) 1) << i;
+
+    return bits;
+#endif
+}
+
+
+/* Get a bitmask of all empty or deleted slots in a group. */
+static uint32_t match_free(const uint8_t * group) {
+#if defined(__SSE2__)
+    return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+#else
+    uint32_t bits = 0;
+    int i;
+
+    for (i = 0; i < GROUP_SIZE; i++)
+        if ((group[i] & 0x80) != 0)
+            bits |= ((uint32_t) 1) << i;
+
+    return bits;
+#endif
+}
+
+
+/* Find the index of the least significant set bit in a non-zero integer. */
+static unsigned int lowest(uint32_t x) {
+#if defined(__GNUC__)
+    return (unsigned int) __builtin_ctz(x);
+#else
+    unsigned int n = 0;
+
+    while ((x & 1) == 0) {
+        x >>= 1;
+        n++;
+    }
+
+    return n;
+#endif
+}
+
+
+/* Hash a connection cookie. */
+static uint64_t hash(struct twist__dict * dict, uint64_t cookie) {
+    uint8_t buf[8];
+    uint64_t x;
+
+    /* Cookies stored in the dict are generated by the socket's PRNG, so an
+     * attacker can't choose keys that collide. The mixing below is only there
+     * to spread those random bits over the whole hash value, and to keep
+     * different sockets' tables from behaving identically. */
+    if (dict->hash == TWIST_HASH_FAST) {
+        x = cookie ^ dict->keys[0];
+        x = (x ^ (x >> 32)) * UINT64_C(0xd6e8feb86659fd93);
+        x = (x ^ (x >> 32)) * UINT64_C(0xd6e8feb86659fd93);
+        return (x ^ (x >> 32)) ^ dict->keys[1];
     }
 
-    return index;
+    be64enc(buf, cookie);
+    return nectar_siphash(dict->seed, buf, 8);
 }
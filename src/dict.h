@@ -12,23 +12,43 @@
  * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
  * PERFORMANCE OF THIS SOFTWARE. */
 
+
 #ifndef LIBTWIST_DICT_H
 #define LIBTWIST_DICT_H
 
 #include "include/twist.h"
 #include "src/conn.h"
+#include "src/mem.h"
+
+
+/* Hash table slot. The cookie is stored next to the connection pointer so
+ * lookups never have to touch non-matching connection structs. */
+struct twist__dict_slot {
+    uint64_t cookie;
+    struct twist__conn * conn;
+};
 
 
-/* Underlying hash table used by `twist__dict`. */
+/* Underlying open-addressed hash table used by `twist__dict`. Slots are
+ * divided into groups of 16, which are probed all at once with the help of
+ * one control byte per slot. */
 struct twist__dict_table {
-    /* Array of hash table buckets. */
-    struct twist__conn ** buckets;
+    /* Array of slots. */
+    struct twist__dict_slot * slots;
+
+    /* Array of control bytes, one per slot. Each byte either marks the slot
+     * as empty or deleted, or holds 7 bits of the hash of the slot's cookie.
+     * Allocated together with `slots`. */
+    uint8_t * ctrl;
 
-    /* Size of the `buckets` array; always a power of two. */
+    /* Number of slots; always a power of two, and a multiple of 16. */
     uint32_t size;
 
-    /* Key mask; always `size-1`. */
+    /* Group mask; always `size/16 - 1`. */
     uint32_t mask;
+
+    /* Number of slots that are either occupied or deleted. */
+    uint32_t used;
 };
 
 
@@ -39,22 +59,32 @@ struct twist__dict {
      * the process of resizing the underlying storage. */
     struct twist__dict_table tables[2];
 
-    /* If non-zero, indicates the next bucket index to be moved from the first
-     * hash table to the second. It then follows that all bucket indexes which
+    /* If non-zero, indicates the next slot index to be moved from the first
+     * hash table to the second. It then follows that all slot indexes which
      * are `< split` have already been moved. */
     uint32_t split;
 
-    /* Seed material for the key hashing function. */
+    /* Hash function in use; either TWIST_HASH_FAST or TWIST_HASH_SIPHASH. */
+    int hash;
+
+    /* Seed material for the key hashing function, and the same material
+     * decoded as two 64-bit keys for the fast hash function. */
     uint8_t seed[16];
+    uint64_t keys[2];
 
     /* Number of entries currently stored in the dict. */
     uint64_t count;
+
+    /* Memory context. */
+    struct twist__mem * mem;
 };
 
 
-/* Initialize a dict instance. The call returns zero or success, or
+/* Initialize a dict instance, using either TWIST_HASH_FAST or
+ * TWIST_HASH_SIPHASH to hash cookies. The call returns zero or success, or
  * TWIST_ENOMEM if a necessary allocation failed. */
-int twist__dict_init(struct twist__dict * dict, uint8_t seed[16]);
+int twist__dict_init(struct twist__dict * dict, uint8_t seed[16], int hash,
+                     struct twist__mem * mem);
 
 /* Free the dict's internal hash table(s). */
 void twist__dict_clear(struct twist__dict * dict);
@@ -76,4 +106,16 @@ int twist__dict_add(struct twist__dict * dict, struct twist__conn * conn);
 void twist__dict_remove(struct twist__dict * dict, struct twist__conn * conn);
 
 
+/* Get the number of bytes allocated for the dict's hash table(s). The second
+ * table only exists while a resize is in progress. */
+static inline size_t twist__dict_memory(const struct twist__dict * dict) {
+    size_t slots = dict->tables[0].size;
+
+    if (dict->split > 0)
+        slots += dict->tables[1].size;
+
+    return slots * (sizeof(struct twist__dict_slot) + 1);
+}
+
+
 #endif
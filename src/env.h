@@ -31,6 +31,13 @@ struct twist__env {
     int (*send_packet)(const struct sockaddr * addr, socklen_t addrlen,
                        const uint8_t * payload, size_t len, void * priv);
 
+    /* Optional user-provided function for sending several UDP packets at
+     * once, typically using `sendmmsg` or a GSO write. It's passed all packets
+     * accumulated during a single socket operation (at most 64 at a time),
+     * and should return 0 unless sending any one of them failed. If NULL,
+     * `send_packet` is called once per packet instead. */
+    int (*send_packets)(const struct twist__packet * const * pkts, size_t count, void * priv);
+
     /* Arbitrary pointer provided by the user for the socket, which will be
      * passed along with each call to any of the functions above. */
     void * priv;
@@ -52,4 +59,27 @@ static inline int twist__env_send(struct twist__env * env, const struct twist__p
 }
 
 
+/* Send a batch of UDP packets. Every packet is handed to the environment even
+ * if sending an earlier one fails. */
+static inline int twist__env_send_many(struct twist__env * env,
+                                       const struct twist__packet * const * pkts, size_t count) {
+    size_t i;
+    int ret;
+
+    if (env->send_packets != NULL) {
+        ret = env->send_packets(pkts, count, env->priv);
+        return (ret == 0 ? TWIST_OK : TWIST_ETRANS);
+    }
+
+    /* Fall back on sending one packet at a time. */
+    ret = TWIST_OK;
+
+    for (i = 0; i < count; i++)
+        if (twist__env_send(env, pkts[i]) != TWIST_OK)
+            ret = TWIST_ETRANS;
+
+    return ret;
+}
+
+
 #endif
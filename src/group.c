@@ -0,0 +1,166 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#include <string.h>
+
+#include <nectar.h>
+
+#include "src/endian.h"
+#include "src/group.h"
+#include "src/mem.h"
+
+
+/* Allocate and initialize a socket group with `count` shards, the i-th of
+ * which will be created using `envs[i]`. The `opts` argument may be NULL. */
+int twist__group_create(struct twist__group ** groupptr, struct twist__env * envs,
+                        unsigned int count, const struct twist_opts * opts) {
+    struct twist__group * group;
+    struct twist__mem mem;
+    unsigned int i, bits;
+    int ret;
+
+    /* Validate the shard count. */
+    if (count == 0 || count > MAX_GROUP_SHARDS) {
+        ret = TWIST_EINVAL;
+        goto err0;
+    }
+
+    /* The allocator is used for the group itself before any shard has had a
+     * chance to validate the options, so check it here. */
+    if (opts != NULL && opts->allocator != NULL && (opts->allocator->alloc == NULL ||
+                                                    opts->allocator->resize == NULL ||
+                                                    opts->allocator->release == NULL)) {
+        ret = TWIST_EINVAL;
+        goto err0;
+    }
+
+    /* Allocate the group and its array of shards. */
+    twist__mem_init(&mem, (opts != NULL ? opts->allocator : NULL), 0);
+
+    group = twist__malloc(&mem, sizeof(*group));
+    if (group == NULL) {
+        ret = TWIST_ENOMEM;
+        goto err0;
+    }
+
+    group->mem = mem;
+
+    group->shards = twist__malloc(&group->mem, count * sizeof(struct twist__sock *));
+    if (group->shards == NULL) {
+        ret = TWIST_ENOMEM;
+        goto err1;
+    }
+
+    /* Find the number of bits needed to encode every shard index. */
+    for (bits = 0; (1u << bits) < count; bits++)
+        ;
+
+    group->count = 0;
+    group->bits = bits;
+
+    /* Create the shards one at a time. */
+    for (i = 0; i < count; i++) {
+        ret = twist__sock_create(&group->shards[i], &envs[i], opts);
+        if (ret != TWIST_OK)
+            goto err2;
+
+        group->count++;
+
+        /* Every shard uses the first shard's ticket key. */
+        if (i > 0)
+            memcpy(group->shards[i]->ticket_key, group->shards[0]->ticket_key, 32);
+
+        group->shards[i]->shard = i;
+        group->shards[i]->shard_bits = bits;
+    }
+
+    /* Generate the routing key. */
+    ret = twist__prng_read(&group->shards[0]->prng, group->route_key, 16);
+    if (ret != TWIST_OK)
+        goto err2;
+
+    *groupptr = group;
+    return TWIST_OK;
+
+    /* Error handling. */
+err2:
+    for (i = 0; i < group->count; i++)
+        twist__sock_destroy(&group->shards[i]);
+
+    twist__free(&mem, group->shards, count * sizeof(struct twist__sock *));
+err1:
+    twist__free(&mem, group, sizeof(*group));
+err0:
+    *groupptr = NULL;
+    return ret;
+}
+
+
+/* Free a socket group and all of its shards. Fails with TWIST_EAGAIN if any
+ * shard has open (as in not yet dropped) connections. */
+int twist__group_destroy(struct twist__group ** groupptr) {
+    struct twist__group * group;
+    struct twist__mem mem;
+    unsigned int i;
+
+    /* Dereference the pointer. */
+    group = *groupptr;
+
+    /* Check every shard before destroying any of them, so a failed call
+     * leaves the group intact. */
+    for (i = 0; i < group->count; i++)
+        if (!twist__timers_empty(&group->shards[i]->timers))
+            return TWIST_EAGAIN;
+
+    for (i = 0; i < group->count; i++)
+        twist__sock_destroy(&group->shards[i]);
+
+    /* Free the group and clear `groupptr`. */
+    mem = group->mem;
+    twist__free(&mem, group->shards, group->count * sizeof(struct twist__sock *));
+    twist__free(&mem, group, sizeof(*group));
+    *groupptr = NULL;
+
+    return TWIST_OK;
+}
+
+
+/* Determine which shard should handle an incoming packet. */
+unsigned int twist__group_route(const struct twist__group * group,
+                                const struct sockaddr * addr, socklen_t addrlen,
+                                const uint8_t * payload, size_t len) {
+    uint64_t cookie;
+
+    /* Packets this short will be discarded by whichever shard gets them. */
+    if (group->bits == 0 || len < 24)
+        return 0;
+
+    /* Data packets start with the destination cookie, while control packets
+     * start with a zero cookie and carry the destination cookie (if any)
+     * 16 bytes in. */
+    cookie = be64dec(payload);
+    if (cookie == 0)
+        cookie = be64dec(payload + 16);
+
+    /* Client handshakes don't have a destination cookie yet, so pick a shard
+     * based on where they're coming from. */
+    if (cookie == 0)
+        return (unsigned int) (nectar_siphash(group->route_key, (const uint8_t *) addr,
+                                              (size_t) addrlen) % group->count);
+
+    /* Bogus cookies may decode to shard indexes that don't exist; they'll be
+     * discarded by whichever shard we pick. */
+    return (unsigned int) (cookie >> (64 - group->bits)) % group->count;
+}
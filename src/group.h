@@ -0,0 +1,71 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#ifndef LIBTWIST_GROUP_H
+#define LIBTWIST_GROUP_H
+
+#include "include/twist.h"
+#include "src/env.h"
+#include "src/mem.h"
+#include "src/sock.h"
+
+
+/* Maximum number of shards in a socket group. */
+#define MAX_GROUP_SHARDS  256
+
+
+/* A socket group is a set of independent sockets ("shards") which together
+ * act like a single socket, letting each shard be driven by its own thread.
+ *
+ * Every local cookie generated by a shard carries the shard's index in its
+ * most significant bits, so packets addressed to an existing connection can
+ * be routed by decoding the cookie. Client handshakes, which don't carry a
+ * cookie, are instead routed by hashing the sender's address. Because tickets
+ * are bound to the client's address, this means a ticket is always redeemed
+ * at the shard which issued it, and each shard's strike register still sees
+ * every attempt to reuse it. All shards also share the same ticket key. */
+struct twist__group {
+    /* Array of `count` shards. */
+    struct twist__sock ** shards;
+    unsigned int count;
+
+    /* Number of cookie bits used to encode a shard's index. */
+    unsigned int bits;
+
+    /* Key used when hashing addresses onto shards. */
+    uint8_t route_key[16];
+
+    /* Memory context used for the group's own allocations. */
+    struct twist__mem mem;
+};
+
+
+/* Allocate and initialize a socket group with `count` shards, the i-th of
+ * which will be created using `envs[i]`. The `opts` argument may be NULL. */
+int twist__group_create(struct twist__group ** groupptr, struct twist__env * envs,
+                        unsigned int count, const struct twist_opts * opts);
+
+/* Free a socket group and all of its shards. Fails with TWIST_EAGAIN if any
+ * shard has open (as in not yet dropped) connections. */
+int twist__group_destroy(struct twist__group ** groupptr);
+
+
+/* Determine which shard should handle an incoming packet. */
+unsigned int twist__group_route(const struct twist__group * group,
+                                const struct sockaddr * addr, socklen_t addrlen,
+                                const uint8_t * payload, size_t len);
+
+
+#endif
@@ -12,33 +12,41 @@
  * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
  * PERFORMANCE OF THIS SOFTWARE. */
 
+
 #include "src/conn.h"
 #include "src/heap.h"
 #include "src/mem.h"
 
 
-/* Minimum (default) and maximum hash table sizes. The maximum size may seem
+/* Number of children per heap node. The children of a node are 96 contiguous
+ * bytes (24-byte entries, which aren't aligned to cache lines), so comparing
+ * them touches two or three cache lines instead of one per level of a binary
+ * heap, and the tree is half as deep. */
+#define HEAP_ARITY  4
+
+
+/* Minimum (default) and maximum heap sizes. The maximum size may seem
  * arbitrary, but it's the highest we can go while being sure multiplication
- * by 8 (size of 64-bit pointers) won't overflow uint32_t. */
+ * by 24 (size of a heap entry) won't overflow uint32_t. */
 #define MIN_HEAP_SIZE  (1 << 6)
-#define MAX_HEAP_SIZE  (1 << 28)
+#define MAX_HEAP_SIZE  (1 << 26)
 
 
 /* Static functions. */
 static int resize(struct twist__heap * heap, uint32_t size);
 static void up(struct twist__heap * heap, uint32_t index);
 static void down(struct twist__heap * heap, uint32_t index);
-static int less(struct twist__heap * heap, uint32_t i, uint32_t j);
-static void swap(struct twist__heap * heap, uint32_t i, uint32_t j);
+static void place(struct twist__heap * heap, uint32_t index, const struct twist__heap_entry * entry);
+static int less(const struct twist__heap_entry * x, const struct twist__heap_entry * y);
 
 
 /* Initialize the heap structure. Returns TWIST_ENOMEM if a necessary
  * allocation failed, otherwise TWIST_OK. */
-int twist__heap_init(struct twist__heap * heap) {
-    struct twist__conn ** entries;
+int twist__heap_init(struct twist__heap * heap, struct twist__mem * mem) {
+    struct twist__heap_entry * entries;
 
     /* Allocate the initial storage array. */
-    entries = twist__malloc(MIN_HEAP_SIZE * sizeof(struct twist__conn *));
+    entries = twist__malloc(mem, MIN_HEAP_SIZE * sizeof(struct twist__heap_entry));
     if (entries == NULL)
         return TWIST_ENOMEM;
 
@@ -46,6 +54,7 @@ int twist__heap_init(struct twist__heap * heap) {
     heap->entries = entries;
     heap->count = 0;
     heap->size = MIN_HEAP_SIZE;
+    heap->mem = mem;
 
     return TWIST_OK;
 }
@@ -53,19 +62,20 @@ int twist__heap_init(struct twist__heap * heap) {
 
 /* Free the heap's underlying storage. */
 void twist__heap_clear(struct twist__heap * heap) {
-    twist__free(heap->entries);
+    twist__free(heap->mem, heap->entries, heap->size * sizeof(struct twist__heap_entry));
 }
 
 
 /* Grab a pointer to the heap's top-most connection, or NULL if the heap
  * is empty. */
 struct twist__conn * twist__heap_peek(struct twist__heap * heap) {
-    return (heap->count > 0 ? heap->entries[0] : NULL);
+    return (heap->count > 0 ? heap->entries[0].conn : NULL);
 }
 
 
 /* Push a new connection onto the heap. */
 int twist__heap_add(struct twist__heap * heap, struct twist__conn * conn) {
+    struct twist__heap_entry * entry;
     int ret;
 
     /* If the underlying array is already full, grow it. */
@@ -80,8 +90,12 @@ int twist__heap_add(struct twist__heap * heap, struct twist__conn * conn) {
 
     /* Append the new connection, then push it up towards the root entry until
      * heap ordering has been restored. */
+    entry = &heap->entries[heap->count];
+    entry->key = (conn->next_tick > 0 ? (uint64_t) conn->next_tick : UINT64_MAX);
+    entry->cookie = conn->local_cookie;
+    entry->conn = conn;
+
     conn->heap_index = heap->count;
-    heap->entries[heap->count] = conn;
     heap->count++;
 
     /* Restore heap ordering. */
@@ -93,16 +107,25 @@ int twist__heap_add(struct twist__heap * heap, struct twist__conn * conn) {
 
 /* Remove a connection from the heap. */
 void twist__heap_remove(struct twist__heap * heap, struct twist__conn * conn) {
+    struct twist__heap_entry * last;
     uint32_t index;
 
-    /* Swap the connection we're removing with the heap's last entry, then
-     * decrement the entry count. */
+    /* Move the heap's last entry into the position of the connection we're
+     * removing, then decrement the entry count. */
     index = conn->heap_index;
     heap->count--;
-    swap(heap, index, heap->count);
 
-    /* Restore heap ordering. */
-    down(heap, index);
+    if (index != heap->count) {
+        last = &heap->entries[heap->count];
+        place(heap, index, last);
+
+        /* Restore heap ordering. The moved entry comes from a different
+         * subtree, so it may have to travel in either direction. */
+        if (index > 0 && less(last, &heap->entries[(index - 1) / HEAP_ARITY]))
+            up(heap, index);
+        else
+            down(heap, index);
+    }
 
     /* If less than 25% of the underlying storage is in use, replace it
      * with a smaller array. */
@@ -117,23 +140,30 @@ void twist__heap_remove(struct twist__heap * heap, struct twist__conn * conn) {
 /* Re-establish the heap ordering after a particular entry's `next_tick` value
  * has changed. */
 void twist__heap_fix(struct twist__heap * heap, struct twist__conn * conn) {
+    struct twist__heap_entry * entry;
     uint32_t index;
 
-    /* Load the original index, because `conn->heap_index` may be modified
-     * during the `down` function call. */
+    /* Refresh the entry's copy of the sort key. */
     index = conn->heap_index;
-
-    down(heap, index);
-    up(heap, index);
+    entry = &heap->entries[index];
+    entry->key = (conn->next_tick > 0 ? (uint64_t) conn->next_tick : UINT64_MAX);
+
+    /* Only one of these calls will actually move the entry. */
+    if (index > 0 && less(entry, &heap->entries[(index - 1) / HEAP_ARITY]))
+        up(heap, index);
+    else
+        down(heap, index);
 }
 
 
 /* Resize the heap's underlying storage. */
 static int resize(struct twist__heap * heap, uint32_t size) {
-    struct twist__conn ** entries;
+    struct twist__heap_entry * entries;
 
     /* Allocate new storage. */
-    entries = twist__realloc(heap->entries, size * sizeof(struct twist__conn *));
+    entries = twist__realloc(heap->mem, heap->entries,
+                             heap->size * sizeof(struct twist__heap_entry),
+                             size * sizeof(struct twist__heap_entry));
     if (entries == NULL)
         return TWIST_ENOMEM;
 
@@ -145,97 +175,90 @@ static int resize(struct twist__heap * heap, uint32_t size) {
 }
 
 
-/* Select the entry at `index` and swap it continuously with its current parent
- * until the path from the heap's root to `index` is ordered again. */
+/* Move the entry at `index` towards the root until the path from the root to
+ * its final position is ordered again. Rather than swapping entries at every
+ * level, parents are shifted down into the hole left behind. */
 static void up(struct twist__heap * heap, uint32_t index) {
+    struct twist__heap_entry entry;
     uint32_t parent;
 
+    entry = heap->entries[index];
+
     while (index != 0) {
-        parent = (index - 1) / 2;
+        parent = (index - 1) / HEAP_ARITY;
 
         /* Stop if the two entries are already in the correct order. */
-        if (less(heap, parent, index))
+        if (!less(&entry, &heap->entries[parent]))
             break;
 
-        swap(heap, index, parent);
+        place(heap, index, &heap->entries[parent]);
         index = parent;
     }
+
+    place(heap, index, &entry);
 }
 
 
-/* Select the entry at `index` and keep swapping it with the lesser of its
- * children until the subtree rooted at `index` is ordered again. */
+/* Move the entry at `index` away from the root, always trading places with
+ * the least of its children, until the subtree rooted at `index` is ordered
+ * again. */
 static void down(struct twist__heap * heap, uint32_t index) {
-    uint32_t left, right, child;
+    struct twist__heap_entry entry;
+    uint32_t first, last, child, i;
+
+    entry = heap->entries[index];
 
     for (;;) {
-        left = 2 * index + 1;
-        right = left + 1;
+        first = HEAP_ARITY * index + 1;
 
         /* As soon as we've reached a leaf node we're done. */
-        if (left >= heap->count)
+        if (first >= heap->count)
             break;
 
-        /* Because this is a min-heap, we're interested in the lesser of the
-         * two child nodes. */
-        if (right >= heap->count || less(heap, left, right))
-            child = left;
-        else
-            child = right;
+        last = first + HEAP_ARITY;
+        if (last > heap->count)
+            last = heap->count;
 
-        /* Stop if the two entries are already in the correct order. */
-        if (less(heap, index, child))
-            break;
+        /* Because this is a min-heap, we're interested in the least of the
+         * child nodes. They're stored next to each other, so this loop only
+         * touches contiguous memory. */
+        child = first;
 
-        /* Swaperoo. */
-        swap(heap, child, index);
-        index = child;
-    }
-}
+        for (i = first + 1; i < last; i++)
+            if (less(&heap->entries[i], &heap->entries[child]))
+                child = i;
 
+        /* Stop if the entries are already in the correct order. */
+        if (!less(&heap->entries[child], &entry))
+            break;
 
-/* Compare two entries in the heap. Returns a non-zero value if the entry
- * at index `i` should be put in front of the entry at index `j`. */
-static int less(struct twist__heap * heap, uint32_t i, uint32_t j) {
-    struct twist__conn * x, * y;
-
-    /* Grab the two connections. */
-    x = heap->entries[i];
-    y = heap->entries[j];
-
-    /* Connections are ordered primarily by their `next_tick` fields. In case
-     * of a tie, we use their local cookies to order them deterministically.
-     * All zero or negative `next_tick` values are considered equal to each
-     * other, but greater than any positive value. */
-    if (x->next_tick <= 0) {
-        if (y->next_tick > 0)
-            return 0;
-    } else {
-        if (x->next_tick < y->next_tick || y->next_tick <= 0)
-            return 1;
-        if (x->next_tick > y->next_tick)
-            return 0;
+        place(heap, index, &heap->entries[child]);
+        index = child;
     }
 
-    /* Use the local cookies, which will be unique, to break ties. */
-    if (x->local_cookie < y->local_cookie)
-        return 1;
-
-    return 0;
+    place(heap, index, &entry);
 }
 
 
-/* Swap the position of entries in the heap. */
-static void swap(struct twist__heap * heap, uint32_t i, uint32_t j) {
-    struct twist__conn * x, * y;
+/* Store an entry at a particular index, updating its connection's
+ * `heap_index` field accordingly. */
+static void place(struct twist__heap * heap, uint32_t index, const struct twist__heap_entry * entry) {
+    heap->entries[index] = *entry;
+    entry->conn->heap_index = index;
+}
 
-    x = heap->entries[i];
-    y = heap->entries[j];
 
-    heap->entries[i] = y;
-    heap->entries[j] = x;
+/* Compare two heap entries. Returns a non-zero value if `x` should be put in
+ * front of `y`.
+ *
+ * Connections are ordered primarily by their `next_tick` fields. In case of a
+ * tie, we use their local cookies to order them deterministically. Because of
+ * how keys are derived, all zero or negative `next_tick` values are considered
+ * equal to each other, but greater than any positive value. */
+static int less(const struct twist__heap_entry * x, const struct twist__heap_entry * y) {
+    if (x->key != y->key)
+        return (x->key < y->key);
 
-    /* Remember to update the affected connections' `heap_index` fields. */
-    x->heap_index = j;
-    y->heap_index = i;
+    /* Use the local cookies, which will be unique, to break ties. */
+    return (x->cookie < y->cookie);
 }
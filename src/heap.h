@@ -16,29 +16,54 @@
 #define LIBTWIST_HEAP_H
 
 #include "include/twist.h"
+#include "src/mem.h"
 
 
-/* This is a simple min-heap for storing connections ordered by when their
+/* Heap entries store copies of the connections' sort keys, which means
+ * restoring heap ordering never has to touch the connection structs (apart
+ * from updating their `heap_index` fields). */
+struct twist__heap_entry {
+    /* The connection's `next_tick` value, with zero and negative values
+     * mapped to UINT64_MAX so they sort after all pending timers. */
+    uint64_t key;
+
+    /* The connection's local cookie, used to break ties. */
+    uint64_t cookie;
+
+    /* The connection itself. */
+    struct twist__conn * conn;
+};
+
+
+/* This is a 4-ary min-heap for storing connections ordered by when their
  * next time-based event is scheduled to occur. */
 struct twist__heap {
     /* Underlying storage array. */
-    struct twist__conn ** entries;
+    struct twist__heap_entry * entries;
 
     /* Number of connections currently stored in the heap. */
     uint32_t count;
 
     /* The underlying storage array's maximum capacity. */
     uint32_t size;
+
+    /* Memory context. */
+    struct twist__mem * mem;
 };
 
 
 /* Initialize the heap structure. Returns TWIST_ENOMEM if a necessary
  * allocation failed, otherwise TWIST_OK. */
-int twist__heap_init(struct twist__heap * heap);
+int twist__heap_init(struct twist__heap * heap, struct twist__mem * mem);
 
 /* Free the heap's underlying storage. */
 void twist__heap_clear(struct twist__heap * heap);
 
+/* Get the number of bytes allocated for the heap's underlying storage. */
+static inline size_t twist__heap_memory(const struct twist__heap * heap) {
+    return (size_t) heap->size * sizeof(struct twist__heap_entry);
+}
+
 
 /* Get the heap's top-most connection, or NULL if the heap is empty. */
 struct twist__conn * twist__heap_peek(struct twist__heap * heap);
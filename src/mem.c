@@ -0,0 +1,77 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "src/mem.h"
+
+
+/* Static functions. */
+static void * std_alloc(size_t size, void * priv);
+static void * std_resize(void * ptr, size_t old_size, size_t size, void * priv);
+static void std_release(void * ptr, size_t size, void * priv);
+
+
+/* The standard library allocator. */
+static const struct twist_allocator std_allocator = {
+    std_alloc,
+    std_resize,
+    std_release,
+    NULL
+};
+
+
+/* Initialize a memory context. If `allocator` is NULL, the standard library's
+ * `malloc`, `realloc` and `free` functions are used. A `budget` of 0 means
+ * allocations are only limited by the allocator itself. */
+void twist__mem_init(struct twist__mem * mem, const struct twist_allocator * allocator,
+                     size_t budget) {
+    mem->allocator = (allocator != NULL ? *allocator : std_allocator);
+    mem->used = 0;
+
+    /* Start shedding load once 7/8 of the budget is in use, which leaves some
+     * headroom for the connections we already have. */
+    if (budget == 0) {
+        mem->budget = SIZE_MAX;
+        mem->soft = SIZE_MAX;
+    } else {
+        mem->budget = budget;
+        mem->soft = budget - budget / 8;
+    }
+}
+
+
+/* Wrapper for `malloc`. */
+static void * std_alloc(size_t size, void * priv) {
+    (void) priv;
+    return malloc(size);
+}
+
+
+/* Wrapper for `realloc`. */
+static void * std_resize(void * ptr, size_t old_size, size_t size, void * priv) {
+    (void) old_size;
+    (void) priv;
+    return realloc(ptr, size);
+}
+
+
+/* Wrapper for `free`. */
+static void std_release(void * ptr, size_t size, void * priv) {
+    (void) size;
+    (void) priv;
+    free(ptr);
+}
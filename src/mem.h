@@ -12,19 +12,84 @@
  * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
  * PERFORMANCE OF THIS SOFTWARE. */
 
+
 #ifndef LIBTWIST_MEM_H
 #define LIBTWIST_MEM_H
 
-#include <stdlib.h>
-
 #include "include/twist.h"
 
 
-/* This would be where to replace the default memory management functions,
- * if one were so inclined. */
-#define twist__malloc   malloc
-#define twist__realloc  realloc
-#define twist__free     free
+/* Every allocation made on behalf of a socket goes through the functions in
+ * its `twist__mem` struct, which is either a copy of the user-provided
+ * `twist_allocator`, or a thin wrapper around the standard library. The
+ * struct also keeps track of how many bytes are allocated, and enforces the
+ * socket's memory budget. */
+struct twist__mem {
+    struct twist_allocator allocator;
+
+    /* Number of bytes currently allocated. */
+    size_t used;
+
+    /* Maximum number of bytes that may be allocated (SIZE_MAX if there is no
+     * budget), and the level at which `twist__mem_pressure` kicks in. */
+    size_t budget;
+    size_t soft;
+};
+
+
+/* Initialize a memory context. If `allocator` is NULL, the standard library's
+ * `malloc`, `realloc` and `free` functions are used. A `budget` of 0 means
+ * allocations are only limited by the allocator itself. */
+void twist__mem_init(struct twist__mem * mem, const struct twist_allocator * allocator,
+                     size_t budget);
+
+
+/* Allocate `size` bytes. Fails by returning NULL if the allocation would
+ * exceed the memory budget. */
+static inline void * twist__malloc(struct twist__mem * mem, size_t size) {
+    void * ptr;
+
+    if (size > mem->budget - mem->used)
+        return NULL;
+
+    ptr = mem->allocator.alloc(size, mem->allocator.priv);
+    if (ptr != NULL)
+        mem->used += size;
+
+    return ptr;
+}
+
+
+/* Resize an allocation from `old_size` to `size` bytes. On failure, NULL is
+ * returned and `ptr` is left untouched. */
+static inline void * twist__realloc(struct twist__mem * mem, void * ptr, size_t old_size, size_t size) {
+    void * res;
+
+    if (size > old_size && size - old_size > mem->budget - mem->used)
+        return NULL;
+
+    res = mem->allocator.resize(ptr, old_size, size, mem->allocator.priv);
+    if (res != NULL)
+        mem->used = mem->used - old_size + size;
+
+    return res;
+}
+
+
+/* Free an allocation of `size` bytes. Passing a NULL pointer is a no-op. */
+static inline void twist__free(struct twist__mem * mem, void * ptr, size_t size) {
+    if (ptr != NULL) {
+        mem->allocator.release(ptr, size, mem->allocator.priv);
+        mem->used -= size;
+    }
+}
+
+
+/* Returns a non-zero value if memory usage is close enough to the budget
+ * that new work (e.g. incoming connections) should be turned away. */
+static inline int twist__mem_pressure(const struct twist__mem * mem) {
+    return (mem->used >= mem->soft);
+}
 
 
 #endif
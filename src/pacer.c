@@ -0,0 +1,90 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include "src/pacer.h"
+
+
+/* Static functions. */
+static void refill(struct twist__pacer * pacer, uint64_t rate, int64_t now);
+
+
+/* Initialize the pacer with a full bucket of `burst` bytes. */
+void twist__pacer_init(struct twist__pacer * pacer, size_t burst, int64_t now) {
+    pacer->tokens = burst;
+    pacer->burst = burst;
+    pacer->last = now;
+}
+
+
+/* Returns a non-zero value if a packet of `len` bytes may be sent right now
+ * at a pacing rate of `rate` bytes per second. */
+int twist__pacer_can_send(struct twist__pacer * pacer, uint64_t rate, size_t len, int64_t now) {
+    if (rate == 0)
+        return 1;
+
+    refill(pacer, rate, now);
+
+    /* A packet larger than the whole bucket is let through once it's full,
+     * or it would never go out at all. */
+    return (pacer->tokens >= len || pacer->tokens == pacer->burst);
+}
+
+
+/* Account for a packet of `len` bytes having been sent. */
+void twist__pacer_sent(struct twist__pacer * pacer, size_t len) {
+    pacer->tokens = (pacer->tokens > len ? pacer->tokens - len : 0);
+}
+
+
+/* Get the time at which a packet of `len` bytes may be sent. */
+int64_t twist__pacer_next(struct twist__pacer * pacer, uint64_t rate, size_t len, int64_t now) {
+    uint64_t missing;
+
+    if (twist__pacer_can_send(pacer, rate, len, now))
+        return now;
+
+    if (len > pacer->burst)
+        len = pacer->burst;
+
+    /* Round up, so the connection doesn't wake up a nanosecond early and
+     * find the bucket still short. */
+    missing = len - pacer->tokens;
+    return pacer->last + (int64_t) ((missing * 1000000000 + rate - 1) / rate);
+}
+
+
+/* Credit the tokens earned since the last refill. Only the time actually
+ * converted into whole bytes is consumed, so slow rates don't lose
+ * fractions of a byte on every call. */
+static void refill(struct twist__pacer * pacer, uint64_t rate, int64_t now) {
+    uint64_t elapsed, full, added;
+
+    if (now <= pacer->last)
+        return;
+
+    elapsed = (uint64_t) (now - pacer->last);
+
+    /* Time it takes to fill the bucket completely. */
+    full = ((uint64_t) (pacer->burst - pacer->tokens) * 1000000000 + rate - 1) / rate;
+
+    if (elapsed >= full) {
+        pacer->tokens = pacer->burst;
+        pacer->last = now;
+        return;
+    }
+
+    added = elapsed * rate / 1000000000;
+    pacer->tokens += (size_t) added;
+    pacer->last += (int64_t) (added * 1000000000 / rate);
+}
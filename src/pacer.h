@@ -0,0 +1,59 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#ifndef LIBTWIST_PACER_H
+#define LIBTWIST_PACER_H
+
+#include "include/twist.h"
+
+
+/* Default burst allowance, in bytes: about ten full-sized packets. */
+#define PACER_DEFAULT_BURST  16384
+
+/* Largest burst allowance, which keeps the arithmetic from overflowing. */
+#define PACER_MAX_BURST      (1 << 30)
+
+
+/* Token bucket spreading a connection's packets out at the pacing rate set
+ * by its congestion controller. The bucket fills at the pacing rate, up to
+ * `burst` bytes, and every packet sent drains it by its size. Rather than
+ * running timers of its own, the pacer tells the connection when the next
+ * packet may go out, for the connection to fold into its `next_tick` value
+ * so the socket's timers wake it up at the right time. */
+struct twist__pacer {
+    /* Bytes that may currently be sent, and the bucket's capacity. */
+    size_t tokens;
+    size_t burst;
+
+    /* Time up to which tokens have been credited. */
+    int64_t last;
+};
+
+
+/* Initialize the pacer with a full bucket of `burst` bytes. */
+void twist__pacer_init(struct twist__pacer * pacer, size_t burst, int64_t now);
+
+/* Returns a non-zero value if a packet of `len` bytes may be sent right now
+ * at a pacing rate of `rate` bytes per second. A rate of 0 disables pacing. */
+int twist__pacer_can_send(struct twist__pacer * pacer, uint64_t rate, size_t len, int64_t now);
+
+/* Account for a packet of `len` bytes having been sent. */
+void twist__pacer_sent(struct twist__pacer * pacer, size_t len);
+
+/* Get the time at which a packet of `len` bytes may be sent at a pacing rate
+ * of `rate` bytes per second, which is `now` if it may be sent right away. */
+int64_t twist__pacer_next(struct twist__pacer * pacer, uint64_t rate, size_t len, int64_t now);
+
+
+#endif
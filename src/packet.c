@@ -18,7 +18,31 @@
 #include "src/packet.h"
 
 
-/* Initialize a packet. */
+/* Allocate a packet with room for a `len` byte payload from the smallest
+ * fitting size class of `pool`. Returns NULL if the allocation fails. */
+struct twist__packet * twist__packet_alloc(struct twist__pool * pool, size_t len) {
+    struct twist__packet * pkt;
+
+    pkt = twist__pool_alloc(pool, PACKET_HEADER_SIZE + len);
+    if (pkt == NULL)
+        return NULL;
+
+    pkt->payload = ((uint8_t *) pkt) + PACKET_HEADER_SIZE;
+    pkt->len = 0;
+    pkt->next = NULL;
+
+    return pkt;
+}
+
+
+/* Return a packet allocated with `twist__packet_alloc` to its pool. */
+void twist__packet_free(struct twist__pool * pool, struct twist__packet * pkt) {
+    twist__pool_free(pool, pkt);
+}
+
+
+/* Initialize a packet, copying the payload into the memory immediately after
+ * the packet struct, which must have room for it. */
 void twist__packet_init(struct twist__packet * pkt,
                         const struct sockaddr * addr, socklen_t addrlen,
                         const uint8_t * payload, size_t len) {
@@ -26,12 +50,8 @@ void twist__packet_init(struct twist__packet * pkt,
 
     /* Use the space after the `struct twist__packet` fields to store the
      * packet's payload. This relies on the assumption that `pkt` is an object
-     * managed by a `twist__pool`.
-     *
-     * The incantations below calculate the location of the first byte
-     * immediately after the packet struct itself, then rounds that address
-     * up to the nearest multiple of 8. */
-    base = (uint8_t *) (((uintptr_t) (pkt + 1) + 7) & ~((uintptr_t) 7));
+     * managed by a `twist__pool` (or a ring slot). */
+    base = ((uint8_t *) pkt) + PACKET_HEADER_SIZE;
 
     /* Store the address. */
     twist__addr_load(&pkt->addr, addr, addrlen);
@@ -45,3 +65,41 @@ void twist__packet_init(struct twist__packet * pkt,
     /* Initialize the list pointer. */
     pkt->next = NULL;
 }
+
+
+/* Initialize a borrowed packet, i.e. one whose payload points directly into
+ * the caller's buffer rather than being copied. Borrowed packets (which are
+ * typically allocated on the stack) are only valid for the duration of the
+ * call they're passed to, and their payloads must be treated as read-only. */
+void twist__packet_wrap(struct twist__packet * pkt,
+                        const struct sockaddr * addr, socklen_t addrlen,
+                        const uint8_t * payload, size_t len) {
+    /* The address is small enough that copying it is cheaper than carrying
+     * around a separate pointer and length. */
+    twist__addr_load(&pkt->addr, addr, addrlen);
+
+    /* The `payload` field isn't const because it's also used to build
+     * outgoing packets, hence the cast. */
+    pkt->payload = (uint8_t *) payload;
+    pkt->len = len;
+
+    pkt->next = NULL;
+}
+
+
+/* Copy a (typically borrowed) packet into an object from `pool`, so it can be
+ * retained past the end of the current call. Returns NULL if allocating the
+ * object failed. */
+struct twist__packet * twist__packet_copy(struct twist__pool * pool,
+                                          const struct twist__packet * pkt) {
+    struct twist__packet * copy;
+
+    copy = twist__packet_alloc(pool, pkt->len);
+    if (copy == NULL)
+        return NULL;
+
+    twist__packet_init(copy, (const struct sockaddr *) &pkt->addr, (socklen_t) pkt->addr.len,
+                       pkt->payload, pkt->len);
+
+    return copy;
+}
@@ -17,6 +17,7 @@
 
 #include "include/twist.h"
 #include "src/addr.h"
+#include "src/pool.h"
 
 
 /* Control packet sizes. */
@@ -24,6 +25,11 @@
 #define TICKET_PACKET_SIZE     168
 
 
+/* Size of a packet struct header, rounded up to a multiple of 8. Pooled
+ * packets store their payload immediately after this many bytes. */
+#define PACKET_HEADER_SIZE  ((sizeof(struct twist__packet) + 7) & ~((size_t) 7))
+
+
 /* Describes an incoming or outgoing packet. */
 struct twist__packet {
     /* Source/destination address. */
@@ -42,10 +48,33 @@ struct twist__packet {
 };
 
 
-/* Initialize a packet. */
+/* Allocate a packet with room for a `len` byte payload from the smallest
+ * fitting size class of `pool`. Returns NULL if the allocation fails. */
+struct twist__packet * twist__packet_alloc(struct twist__pool * pool, size_t len);
+
+/* Return a packet allocated with `twist__packet_alloc` to its pool. */
+void twist__packet_free(struct twist__pool * pool, struct twist__packet * pkt);
+
+
+/* Initialize a packet, copying the payload into the memory immediately after
+ * the packet struct, which must have room for it. */
 void twist__packet_init(struct twist__packet * pkt,
                         const struct sockaddr * addr, socklen_t addrlen,
                         const uint8_t * payload, size_t len);
 
+/* Initialize a borrowed packet, i.e. one whose payload points directly into
+ * the caller's buffer rather than being copied. Borrowed packets (which are
+ * typically allocated on the stack) are only valid for the duration of the
+ * call they're passed to, and their payloads must be treated as read-only. */
+void twist__packet_wrap(struct twist__packet * pkt,
+                        const struct sockaddr * addr, socklen_t addrlen,
+                        const uint8_t * payload, size_t len);
+
+/* Copy a (typically borrowed) packet into an object from `pool`, so it can be
+ * retained past the end of the current call. Returns NULL if allocating the
+ * object failed. */
+struct twist__packet * twist__packet_copy(struct twist__pool * pool,
+                                          const struct twist__packet * pkt);
+
 
 #endif
@@ -12,69 +12,317 @@
  * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
  * PERFORMANCE OF THIS SOFTWARE. */
 
+
 #include <limits.h>
 
 #include "src/mem.h"
 #include "src/pool.h"
 
 
+/* Size of the pointer preceding every object, and of the chunk header, both
+ * rounded up so objects stay 16-byte aligned. */
+#define OBJECT_HEADER_SIZE  16
+#define CHUNK_HEADER_SIZE   ((sizeof(struct twist__pool_chunk) + 15) & ~((size_t) 15))
+
+
+/* Object sizes, indexed by size class. */
+static const size_t sizes[POOL_CLASSES] = {
+    POOL_SMALL_SIZE,
+    POOL_OBJECT_SIZE,
+    POOL_LARGE_SIZE,
+    POOL_HUGE_SIZE
+};
+
+
+/* Static functions. */
+static int classify(size_t size);
+static void cull(struct twist__pool * pool, struct twist__pool_class * cls, size_t keep);
+static struct twist__pool_chunk * grow(struct twist__pool * pool, int index);
+static void push(struct twist__pool_chunk ** list, struct twist__pool_chunk * chunk);
+static void detach(struct twist__pool_chunk ** list, struct twist__pool_chunk * chunk);
+
+
 /* Initialize an object pool. */
-void twist__pool_init(struct twist__pool * pool) {
-    pool->head = NULL;
-    pool->count = 0;
+void twist__pool_init(struct twist__pool * pool, struct twist__mem * mem) {
+    int i;
+
+    for (i = 0; i < POOL_CLASSES; i++) {
+        pool->classes[i].avail = NULL;
+        pool->classes[i].full = NULL;
+        pool->classes[i].count = 0;
+        pool->classes[i].used = 0;
+        pool->classes[i].peak = 0;
+        pool->classes[i].mark = 0;
+    }
+
+    pool->min = 0;
+    pool->max = UINT_MAX;
+    pool->window = POOL_DEFAULT_WINDOW;
+    pool->chunks = 0;
+    pool->epoch = 0;
+    pool->mem = mem;
 }
 
 
-/* Free all objects owned by the pool. */
+/* Free all chunks owned by the pool. Every object must have been returned to
+ * the pool first. */
 void twist__pool_clear(struct twist__pool * pool) {
     twist__pool_cull(pool, 0);
 }
 
 
-/* Grab an object from the pool or, if the pool is empty, allocate a new one. */
-void * twist__pool_alloc(struct twist__pool * pool) {
-    void * obj;
+/* Get the actual size of objects allocated with a requested size of `size`
+ * bytes, or 0 if `size` is larger than MAX_POOL_SIZE. */
+size_t twist__pool_size(size_t size) {
+    int i = classify(size);
+    return (i >= 0 ? sizes[i] : 0);
+}
+
+
+/* Grab an object of at least `size` bytes from the pool, allocating a new
+ * chunk if necessary. Returns NULL if the allocation fails or `size` is larger
+ * than MAX_POOL_SIZE. */
+void * twist__pool_alloc(struct twist__pool * pool, size_t size) {
+    struct twist__pool_class * cls;
+    struct twist__pool_chunk * chunk;
+    uint8_t * obj;
+    int i;
+
+    i = classify(size);
+    if (i < 0)
+        return NULL;
+
+    cls = &pool->classes[i];
 
-    if (pool->head != NULL) {
-        obj = pool->head;
-        pool->head = *((void **) obj);
-        pool->count--;
+    /* Allocate from the first chunk with any room left, or a brand new one. */
+    chunk = cls->avail;
+    if (chunk == NULL) {
+        chunk = grow(pool, i);
+        if (chunk == NULL)
+            return NULL;
+    }
+
+    /* Prefer recycled objects, since they're more likely to be cached. */
+    if (chunk->free != NULL) {
+        obj = chunk->free;
+        chunk->free = *((void **) obj);
     } else {
-        obj = twist__malloc(POOL_OBJECT_SIZE);
+        obj = chunk->carve + OBJECT_HEADER_SIZE;
+        *((struct twist__pool_chunk **) chunk->carve) = chunk;
+        chunk->carve += OBJECT_HEADER_SIZE + sizes[i];
+    }
+
+    chunk->used++;
+    cls->count--;
+
+    cls->used++;
+    if (cls->used > cls->peak)
+        cls->peak = cls->used;
+
+    /* Move the chunk out of the way if it's now full. */
+    if (chunk->used == chunk->capacity) {
+        detach(&cls->avail, chunk);
+        push(&cls->full, chunk);
     }
 
     return obj;
 }
 
 
-/* Recycle an object back into the pool. If the pool is already at capacity,
- * the object will be freed. */
+/* Recycle an object back into the pool. */
 void twist__pool_free(struct twist__pool * pool, void * obj) {
-    /* Doesn't hurt to be paranoid about these things. */
-    if (pool->count == UINT_MAX) {
-        twist__free(obj);
-        return;
+    struct twist__pool_class * cls;
+    struct twist__pool_chunk * chunk;
+
+    /* Find the object's chunk, and with it, the size class. */
+    chunk = *((struct twist__pool_chunk **) (((uint8_t *) obj) - OBJECT_HEADER_SIZE));
+    cls = &pool->classes[chunk->index];
+
+    /* A chunk that was full becomes available again. Either way, move it to
+     * the front of the list, so the memory we just touched is reused first. */
+    if (chunk->used == chunk->capacity) {
+        detach(&cls->full, chunk);
+    } else {
+        detach(&cls->avail, chunk);
     }
 
+    push(&cls->avail, chunk);
+
     /* Link to the previous object by treating the very first bytes of this
      * object as a `void *` pointer. */
-    *((void **) obj) = pool->head;
+    *((void **) obj) = chunk->free;
+    chunk->free = obj;
 
-    pool->head = obj;
-    pool->count++;
+    chunk->used--;
+    cls->count++;
+    cls->used--;
 }
 
 
-/* Free all but `keep` objects from the pool. If the pool doesn't contain more
- * than `keep` objects the function call does nothing. */
+/* Free entirely unused chunks, as long as at least `keep` objects of each
+ * size class remain available in the pool. */
 void twist__pool_cull(struct twist__pool * pool, unsigned int keep) {
-    void * next;
-
-    /* Free objects until only `keep` are left. */
-    while (pool->count > keep) {
-        next = *((void **) pool->head);
-        twist__free(pool->head);
-        pool->head = next;
-        pool->count--;
+    int i;
+
+    for (i = 0; i < POOL_CLASSES; i++)
+        cull(pool, &pool->classes[i], keep);
+}
+
+
+/* Get the number of bytes allocated by the pool, i.e. the total size of all
+ * of its chunks. */
+size_t twist__pool_reserved(struct twist__pool * pool) {
+    return pool->chunks * POOL_CHUNK_SIZE;
+}
+
+
+/* Get the number of bytes currently handed out as objects. */
+size_t twist__pool_used(struct twist__pool * pool) {
+    size_t total;
+    int i;
+
+    total = 0;
+
+    for (i = 0; i < POOL_CLASSES; i++)
+        total += pool->classes[i].used * sizes[i];
+
+    return total;
+}
+
+
+/* Set the pool's retention policy: `twist__pool_trim` will always keep at
+ * least `min` and at most `max` spare objects of each size class, and the
+ * high-water marks it's based on decay once per `window` nanoseconds. */
+void twist__pool_retain(struct twist__pool * pool, unsigned int min, unsigned int max,
+                        int64_t window) {
+    pool->min = min;
+    pool->max = max;
+    pool->window = window;
+}
+
+
+/* Free unused chunks according to the pool's retention policy. For each size
+ * class, the pool keeps enough spare objects to get back to the recent
+ * high-water mark of objects in use, which halves with every window that
+ * doesn't reach it, so memory is only released after sustained idleness. */
+void twist__pool_trim(struct twist__pool * pool, int64_t now) {
+    struct twist__pool_class * cls;
+    size_t mark, keep;
+    int i, roll;
+
+    /* Start a new window if the current one has run its course. */
+    roll = (now - pool->epoch >= pool->window);
+    if (roll)
+        pool->epoch = now;
+
+    for (i = 0; i < POOL_CLASSES; i++) {
+        cls = &pool->classes[i];
+
+        /* Fold the finished window's peak into the decaying mark. */
+        if (roll) {
+            cls->mark /= 2;
+            if (cls->peak > cls->mark)
+                cls->mark = cls->peak;
+
+            cls->peak = cls->used;
+        }
+
+        mark = (cls->peak > cls->mark ? cls->peak : cls->mark);
+
+        /* Keep enough spare objects to reach the mark, within bounds. */
+        keep = (mark > cls->used ? mark - cls->used : 0);
+        if (keep < pool->min)
+            keep = pool->min;
+        if (keep > pool->max)
+            keep = pool->max;
+
+        cull(pool, cls, keep);
+    }
+}
+
+
+/* Find the smallest size class which fits `size` bytes, or -1 if there
+ * is none. */
+static int classify(size_t size) {
+    int i;
+
+    for (i = 0; i < POOL_CLASSES; i++)
+        if (size <= sizes[i])
+            return i;
+
+    return -1;
+}
+
+
+/* Free entirely unused chunks of a size class, as long as at least `keep`
+ * objects remain available. */
+static void cull(struct twist__pool * pool, struct twist__pool_class * cls, size_t keep) {
+    struct twist__pool_chunk * chunk, * next;
+
+    /* Full chunks are by definition in use, so we only need to look at the
+     * available ones. */
+    for (chunk = cls->avail; chunk != NULL; chunk = next) {
+        next = chunk->next;
+
+        if (chunk->used != 0 || cls->count < keep + chunk->capacity)
+            continue;
+
+        detach(&cls->avail, chunk);
+        cls->count -= chunk->capacity;
+
+        twist__free(pool->mem, chunk, POOL_CHUNK_SIZE);
+        pool->chunks--;
+    }
+}
+
+
+/* Allocate a new chunk for objects of a particular size class, and add it to
+ * the front of the class's list of available chunks. */
+static struct twist__pool_chunk * grow(struct twist__pool * pool, int index) {
+    struct twist__pool_class * cls;
+    struct twist__pool_chunk * chunk;
+
+    cls = &pool->classes[index];
+
+    chunk = twist__malloc(pool->mem, POOL_CHUNK_SIZE);
+    if (chunk == NULL)
+        return NULL;
+
+    chunk->free = NULL;
+    chunk->carve = ((uint8_t *) chunk) + CHUNK_HEADER_SIZE;
+    chunk->used = 0;
+    chunk->capacity = (unsigned int) ((POOL_CHUNK_SIZE - CHUNK_HEADER_SIZE) /
+                                      (OBJECT_HEADER_SIZE + sizes[index]));
+    chunk->index = index;
+
+    push(&cls->avail, chunk);
+    cls->count += chunk->capacity;
+    pool->chunks++;
+
+    return chunk;
+}
+
+
+/* Prepend a chunk to a list. */
+static void push(struct twist__pool_chunk ** list, struct twist__pool_chunk * chunk) {
+    chunk->prev = NULL;
+    chunk->next = *list;
+
+    if (*list != NULL)
+        (*list)->prev = chunk;
+
+    *list = chunk;
+}
+
+
+/* Unlink a chunk from a list. */
+static void detach(struct twist__pool_chunk ** list, struct twist__pool_chunk * chunk) {
+    if (chunk->next != NULL)
+        chunk->next->prev = chunk->prev;
+
+    if (chunk->prev != NULL) {
+        chunk->prev->next = chunk->next;
+    } else {
+        *list = chunk->next;
     }
 }
@@ -12,47 +12,147 @@
  * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
  * PERFORMANCE OF THIS SOFTWARE. */
 
+
 #ifndef LIBTWIST_POOL_H
 #define LIBTWIST_POOL_H
 
 #include "include/twist.h"
+#include "src/mem.h"
 
 
-/* Fixed size of pooled objects. This must be greater than MAX_PACKET_SIZE +
- * sizeof(struct twist__packet), and rounding it up to 2^10 + 2^9 should make
- * the `malloc` implementation's life a little bit easier. */
+/* Object size classes. POOL_OBJECT_SIZE must be greater than MAX_PACKET_SIZE
+ * + sizeof(struct twist__packet), and rounding it up to 2^10 + 2^9 should
+ * make the `malloc` implementation's life a little bit easier. The smaller
+ * class is meant for control packets, and the larger ones for buffer slabs
+ * holding bulk data. */
+#define POOL_SMALL_SIZE   256
 #define POOL_OBJECT_SIZE  1536
+#define POOL_LARGE_SIZE   16384
+#define POOL_HUGE_SIZE    65536
+
+/* Number of size classes, and the largest object size. */
+#define POOL_CLASSES       4
+#define MAX_POOL_SIZE      POOL_HUGE_SIZE
+
+/* Size of the chunks objects are carved out of. */
+#define POOL_CHUNK_SIZE    (2 * 1024 * 1024)
+
+/* Default length of the window used when deciding how many objects to retain
+ * in `twist__pool_trim`, in nanoseconds. */
+#define POOL_DEFAULT_WINDOW  1000000000
+
+
+/* A chunk is a large block of memory which is carved into objects of a single
+ * size class. Every object is preceded by a pointer to its chunk. */
+struct twist__pool_chunk {
+    /* Intrusive list pointers. */
+    struct twist__pool_chunk * prev;
+    struct twist__pool_chunk * next;
+
+    /* Linked list of objects that have been returned to the chunk. */
+    void * free;
+
+    /* Objects are carved out of the chunk lazily, starting at `carve`, so the
+     * untouched memory at the end of the chunk doesn't need to be paged in. */
+    uint8_t * carve;
+
+    /* Number of objects currently handed out, and the total number of objects
+     * the chunk can hold. */
+    unsigned int used;
+    unsigned int capacity;
+
+    /* Size class of the chunk's objects. */
+    int index;
+};
+
+
+/* Per size class state. */
+struct twist__pool_class {
+    /* Chunks with at least one available object, in the order they should be
+     * allocated from, and chunks without any. */
+    struct twist__pool_chunk * avail;
+    struct twist__pool_chunk * full;
 
+    /* Total number of available objects (free or not yet carved), and
+     * number of objects currently handed out. */
+    size_t count;
+    size_t used;
 
-/* The `twist__pool` struct implements a simple last-in-first-out pool of
- * fixed-size blocks of memory. It doesn't free any objects on its own accord,
- * instead the user is expected to use `twist__pool_cull`. */
+    /* Highest value of `used` seen during the current window, and the
+     * decaying high-water mark carried over from earlier windows. */
+    size_t peak;
+    size_t mark;
+};
+
+
+/* The `twist__pool` struct implements an object pool with a separate set of
+ * chunks for each size class. Objects are returned to the chunk they came
+ * from, and allocation favours the most recently freed-into chunk. Chunks are
+ * never freed on the pool's own accord; instead the user is expected to use
+ * `twist__pool_cull`, which frees chunks that are entirely unused. */
 struct twist__pool {
-    /* Linked list of free objects. */
-    void * head;
+    struct twist__pool_class classes[POOL_CLASSES];
+
+    /* Total number of chunks allocated by the pool. */
+    size_t chunks;
 
-    /* Number of free objects in the pool. */
-    unsigned int count;
+    /* Retention policy used by `twist__pool_trim`. */
+    unsigned int min;
+    unsigned int max;
+    int64_t window;
+
+    /* Start of the current window. */
+    int64_t epoch;
+
+    /* Memory context. */
+    struct twist__mem * mem;
 };
 
 
 /* Initialize an object pool. */
-void twist__pool_init(struct twist__pool * pool);
+void twist__pool_init(struct twist__pool * pool, struct twist__mem * mem);
 
-/* Free all objects owned by the pool. */
+/* Free all chunks owned by the pool. Every object must have been returned to
+ * the pool first. */
 void twist__pool_clear(struct twist__pool * pool);
 
 
-/* Grab an object from the pool or, if the pool is empty, allocate a new one. */
-void * twist__pool_alloc(struct twist__pool * pool);
+/* Get the actual size of objects allocated with a requested size of `size`
+ * bytes, or 0 if `size` is larger than MAX_POOL_SIZE. */
+size_t twist__pool_size(size_t size);
+
+/* Grab an object of at least `size` bytes from the pool, allocating a new
+ * chunk if necessary. Returns NULL if the allocation fails or `size` is larger
+ * than MAX_POOL_SIZE. */
+void * twist__pool_alloc(struct twist__pool * pool, size_t size);
 
-/* Recycle an object back into the pool. If the pool is already at capacity,
- * the object will be freed. */
+/* Recycle an object back into the pool. */
 void twist__pool_free(struct twist__pool * pool, void * obj);
 
-/* Free all but `keep` objects from the pool. If there are already at most
- * `keep` objects in the pool the function call does nothing. */
+/* Free entirely unused chunks, as long as at least `keep` objects of each
+ * size class remain available in the pool. */
 void twist__pool_cull(struct twist__pool * pool, unsigned int keep);
 
 
+/* Get the number of bytes allocated by the pool, i.e. the total size of all
+ * of its chunks. */
+size_t twist__pool_reserved(struct twist__pool * pool);
+
+/* Get the number of bytes currently handed out as objects. */
+size_t twist__pool_used(struct twist__pool * pool);
+
+
+/* Set the pool's retention policy: `twist__pool_trim` will always keep at
+ * least `min` and at most `max` spare objects of each size class, and the
+ * high-water marks it's based on decay once per `window` nanoseconds. */
+void twist__pool_retain(struct twist__pool * pool, unsigned int min, unsigned int max,
+                        int64_t window);
+
+/* Free unused chunks according to the pool's retention policy. For each size
+ * class, the pool keeps enough spare objects to get back to the recent
+ * high-water mark of objects in use, which halves with every window that
+ * doesn't reach it, so memory is only released after sustained idleness. */
+void twist__pool_trim(struct twist__pool * pool, int64_t now);
+
+
 #endif
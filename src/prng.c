@@ -31,11 +31,12 @@ static int seed(struct twist__prng * prng);
 
 /* Initialize the PRNG context. Returns TWIST_ENOMEM if a necessary memory
  * allocation fails, otherwise TWIST_OK. */
-int twist__prng_init(struct twist__prng * prng, struct twist__env * env) {
+int twist__prng_init(struct twist__prng * prng, struct twist__env * env,
+                     struct twist__mem * mem) {
     uint8_t * buf;
 
     /* Allocate the buffer. */
-    buf = twist__malloc(BUFFER_SIZE);
+    buf = twist__malloc(mem, BUFFER_SIZE);
     if (buf == NULL)
         return TWIST_ENOMEM;
 
@@ -45,6 +46,7 @@ int twist__prng_init(struct twist__prng * prng, struct twist__env * env) {
     prng->consumed = BUFFER_SIZE;
     prng->reseed = 0;
     prng->env = env;
+    prng->mem = mem;
 
     return TWIST_OK;
 }
@@ -52,7 +54,7 @@ int twist__prng_init(struct twist__prng * prng, struct twist__env * env) {
 
 /* Free the PRNG context's allocated memory. */
 void twist__prng_clear(struct twist__prng * prng) {
-    twist__free(prng->buf);
+    twist__free(prng->mem, prng->buf, BUFFER_SIZE);
 }
 
 
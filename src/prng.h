@@ -19,6 +19,7 @@
 
 #include "include/twist.h"
 #include "src/env.h"
+#include "src/mem.h"
 
 
 /* Generates non-deterministic bits using ChaCha20 keystreams. */
@@ -43,12 +44,16 @@ struct twist__prng {
 
     /* Environment. */
     struct twist__env * env;
+
+    /* Memory context. */
+    struct twist__mem * mem;
 };
 
 
 /* Initialize the PRNG context. Returns TWIST_ENOMEM if a necessary memory
  * allocation fails, otherwise TWIST_OK. */
-int twist__prng_init(struct twist__prng * prng, struct twist__env * env);
+int twist__prng_init(struct twist__prng * prng, struct twist__env * env,
+                     struct twist__mem * mem);
 
 /* Free the PRNG context's allocated memory. */
 void twist__prng_clear(struct twist__prng * prng);
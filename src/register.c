@@ -36,18 +36,19 @@ static int resize(struct twist__register * reg, uint32_t size,
 
 /* Initialize the register. Returns TWIST_ENOMEM if a necessary allocation
  * failed, otherwise TWIST_OK. */
-int twist__register_init(struct twist__register * reg, uint32_t lifetime) {
+int twist__register_init(struct twist__register * reg, uint32_t lifetime,
+                         struct twist__mem * mem) {
     uint32_t * offsets;
     uint32_t * bits;
 
     /* Allocate some memory for our circular arrays. */
-    offsets = twist__malloc(lifetime * sizeof(*offsets));
+    offsets = twist__malloc(mem, lifetime * sizeof(*offsets));
     if (offsets == NULL)
         return TWIST_ENOMEM;
 
-    bits = twist__malloc(sizeof(*bits) * MIN_BITS_SIZE);
+    bits = twist__malloc(mem, sizeof(*bits) * MIN_BITS_SIZE);
     if (bits == NULL) {
-        twist__free(offsets);
+        twist__free(mem, offsets, lifetime * sizeof(*offsets));
         return TWIST_ENOMEM;
     }
 
@@ -64,14 +65,16 @@ int twist__register_init(struct twist__register * reg, uint32_t lifetime) {
     reg->size = MIN_BITS_SIZE;
     reg->mask = MIN_BITS_SIZE - 1;
 
+    reg->mem = mem;
+
     return TWIST_OK;
 }
 
 
 /* Free all heap memory managed by the register. */
 void twist__register_clear(struct twist__register * reg) {
-    twist__free(reg->offsets);
-    twist__free(reg->bits);
+    twist__free(reg->mem, reg->offsets, reg->lifetime * sizeof(*reg->offsets));
+    twist__free(reg->mem, reg->bits, reg->size * sizeof(*reg->bits));
 }
 
 
@@ -268,7 +271,7 @@ static int resize(struct twist__register * reg, uint32_t size,
 
     /* Use `realloc` when possible to simply truncate or extend the array. */
     if (head < tail && tail <= size) {
-        bits = twist__realloc(reg->bits, size * sizeof(*bits));
+        bits = twist__realloc(reg->mem, reg->bits, reg->size * sizeof(*bits), size * sizeof(*bits));
         if (bits == NULL)
             return TWIST_ENOMEM;
 
@@ -276,7 +279,7 @@ static int resize(struct twist__register * reg, uint32_t size,
     }
 
     /* Allocate our new array and copy the interesting parts of `reg->bits`. */
-    bits = twist__malloc(size * sizeof(*bits));
+    bits = twist__malloc(reg->mem, size * sizeof(*bits));
     if (bits == NULL)
         return TWIST_ENOMEM;
 
@@ -295,7 +298,7 @@ static int resize(struct twist__register * reg, uint32_t size,
     }
 
     /* Free the old array. */
-    twist__free(reg->bits);
+    twist__free(reg->mem, reg->bits, reg->size * sizeof(*bits));
 
     /* Store the new array. */
 done:
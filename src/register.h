@@ -16,6 +16,7 @@
 #define LIBTWIST_REGISTER_H
 
 #include "include/twist.h"
+#include "src/mem.h"
 
 
 /* The `twist__register` struct generates and validates single-use, fixed
@@ -50,12 +51,16 @@ struct twist__register {
      * mask to replace `x % size` with `x & mask`. */
     uint32_t size;
     uint32_t mask;
+
+    /* Memory context. */
+    struct twist__mem * mem;
 };
 
 
 /* Initialize the register. Returns TWIST_ENOMEM if a necessary allocation
  * failed, otherwise TWIST_OK. */
-int twist__register_init(struct twist__register * reg, uint32_t lifetime);
+int twist__register_init(struct twist__register * reg, uint32_t lifetime,
+                         struct twist__mem * mem);
 
 /* Free all heap memory managed by the register. */
 void twist__register_clear(struct twist__register * reg);
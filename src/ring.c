@@ -0,0 +1,126 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#include "src/mem.h"
+#include "src/ring.h"
+
+
+/* Atomic loads and stores of the ring's indexes. The acquire/release pairs
+ * make sure a slot's contents are visible to the other thread before its
+ * index is. */
+#if defined(__GNUC__)
+#define LOAD_ACQUIRE(ptr)        __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(ptr, val)  __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#else
+#error "twist__ring requires GCC-style __atomic builtins"
+#endif
+
+
+/* Static functions. */
+static struct twist__packet * slot(struct twist__ring * ring, uint64_t index);
+
+
+/* Initialize a ring with room for `size` packets, which must be a power
+ * of two. */
+int twist__ring_init(struct twist__ring * ring, size_t size, struct twist__mem * mem) {
+    if (size == 0 || size > MAX_RING_SIZE || (size & (size - 1)) != 0)
+        return TWIST_EINVAL;
+
+    ring->slots = twist__malloc(mem, size * RING_SLOT_SIZE);
+    if (ring->slots == NULL)
+        return TWIST_ENOMEM;
+
+    ring->mask = size - 1;
+    ring->mem = mem;
+
+    ring->head = 0;
+    ring->tail_cache = 0;
+    ring->tail = 0;
+    ring->head_cache = 0;
+
+    return TWIST_OK;
+}
+
+
+/* Free the ring's slots. */
+void twist__ring_clear(struct twist__ring * ring) {
+    twist__free(ring->mem, ring->slots, (size_t) (ring->mask + 1) * RING_SLOT_SIZE);
+    ring->slots = NULL;
+}
+
+
+/* Producer: get a pointer to the next free slot, or NULL if the ring is full.
+ * The packet's payload pointer is set up, but all other fields should be
+ * filled in by the caller (e.g. using `twist__packet_init`) before the packet
+ * is published. */
+struct twist__packet * twist__ring_reserve(struct twist__ring * ring) {
+    struct twist__packet * pkt;
+    uint64_t tail;
+
+    tail = ring->tail;
+
+    /* Only look at the consumer's index if our cached copy says the ring
+     * is full. */
+    if (tail - ring->head_cache > ring->mask) {
+        ring->head_cache = LOAD_ACQUIRE(&ring->head);
+        if (tail - ring->head_cache > ring->mask)
+            return NULL;
+    }
+
+    pkt = slot(ring, tail);
+    pkt->payload = ((uint8_t *) pkt) + PACKET_HEADER_SIZE;
+    pkt->next = NULL;
+
+    return pkt;
+}
+
+
+/* Producer: make the slot returned by the last `twist__ring_reserve` call
+ * visible to the consumer. */
+void twist__ring_publish(struct twist__ring * ring) {
+    STORE_RELEASE(&ring->tail, ring->tail + 1);
+}
+
+
+/* Consumer: get a pointer to the oldest published packet, or NULL if the ring
+ * is empty. The packet remains valid until `twist__ring_release` is called. */
+struct twist__packet * twist__ring_peek(struct twist__ring * ring) {
+    uint64_t head;
+
+    head = ring->head;
+
+    /* Only look at the producer's index if our cached copy says the ring
+     * is empty. */
+    if (head == ring->tail_cache) {
+        ring->tail_cache = LOAD_ACQUIRE(&ring->tail);
+        if (head == ring->tail_cache)
+            return NULL;
+    }
+
+    return slot(ring, head);
+}
+
+
+/* Consumer: hand the slot returned by the last `twist__ring_peek` call back
+ * to the producer. */
+void twist__ring_release(struct twist__ring * ring) {
+    STORE_RELEASE(&ring->head, ring->head + 1);
+}
+
+
+/* Get the packet stored in a particular slot. */
+static struct twist__packet * slot(struct twist__ring * ring, uint64_t index) {
+    return (struct twist__packet *) (ring->slots + (size_t) (index & ring->mask) * RING_SLOT_SIZE);
+}
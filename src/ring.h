@@ -0,0 +1,97 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+
+#ifndef LIBTWIST_RING_H
+#define LIBTWIST_RING_H
+
+#include "include/twist.h"
+#include "src/mem.h"
+#include "src/packet.h"
+#include "src/pool.h"
+
+
+/* Assumed size of a CPU cache line. */
+#define CACHE_LINE_SIZE  64
+
+/* Maximum number of slots in a ring. */
+#define MAX_RING_SIZE  (1 << 20)
+
+/* Every slot is a `twist__packet` followed by its payload, exactly like an
+ * object from a `twist__pool`, which limits how large a payload can be. */
+#define RING_SLOT_SIZE     POOL_OBJECT_SIZE
+#define RING_MAX_PAYLOAD   (RING_SLOT_SIZE - PACKET_HEADER_SIZE)
+
+
+/* The `twist__ring` struct is a bounded, lock-free, single-producer and
+ * single-consumer queue of packets. It's used to pass datagrams between a
+ * socket and a separate I/O thread without either of them ever blocking.
+ *
+ * Packets are stored inline in a contiguous array of slots, and are written
+ * in place by the producer (`twist__ring_reserve` followed by
+ * `twist__ring_publish`) and read in place by the consumer (`twist__ring_peek`
+ * followed by `twist__ring_release`).
+ *
+ * The producer and consumer indexes are kept on separate cache lines, and each
+ * side keeps a private copy of the other side's index, which it only refreshes
+ * when the ring appears to be full (or empty). This way the two threads only
+ * touch each other's cache lines when they have to. */
+struct twist__ring {
+    /* Read-only after initialization. */
+    uint8_t * slots;
+    uint64_t mask;
+    struct twist__mem * mem;
+    uint8_t pad0[CACHE_LINE_SIZE - 2 * sizeof(void *) - sizeof(uint64_t)];
+
+    /* Owned by the consumer. */
+    uint64_t head;
+    uint64_t tail_cache;
+    uint8_t pad1[CACHE_LINE_SIZE - 2 * sizeof(uint64_t)];
+
+    /* Owned by the producer. */
+    uint64_t tail;
+    uint64_t head_cache;
+    uint8_t pad2[CACHE_LINE_SIZE - 2 * sizeof(uint64_t)];
+};
+
+
+/* Initialize a ring with room for `size` packets, which must be a power
+ * of two. */
+int twist__ring_init(struct twist__ring * ring, size_t size, struct twist__mem * mem);
+
+/* Free the ring's slots. */
+void twist__ring_clear(struct twist__ring * ring);
+
+
+/* Producer: get a pointer to the next free slot, or NULL if the ring is full.
+ * The packet's payload pointer is set up, but all other fields should be
+ * filled in by the caller (e.g. using `twist__packet_init`) before the packet
+ * is published. */
+struct twist__packet * twist__ring_reserve(struct twist__ring * ring);
+
+/* Producer: make the slot returned by the last `twist__ring_reserve` call
+ * visible to the consumer. */
+void twist__ring_publish(struct twist__ring * ring);
+
+
+/* Consumer: get a pointer to the oldest published packet, or NULL if the ring
+ * is empty. The packet remains valid until `twist__ring_release` is called. */
+struct twist__packet * twist__ring_peek(struct twist__ring * ring);
+
+/* Consumer: hand the slot returned by the last `twist__ring_peek` call back
+ * to the producer. */
+void twist__ring_release(struct twist__ring * ring);
+
+
+#endif
@@ -0,0 +1,531 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <string.h>
+
+#include "src/mem.h"
+#include "src/sent.h"
+
+
+/* Minimum (default) and maximum ring sizes, in packets. */
+#define MIN_SENT_SIZE  (1 << 6)
+#define MAX_SENT_SIZE  (1 << 22)
+
+/* A packet is declared lost once a packet sent this many packets later has
+ * been acknowledged... */
+#define PACKET_THRESHOLD  3
+
+/* ...or once 9/8 of an RTT has passed since a later packet was sent. */
+#define TIME_THRESHOLD_NUM  9
+#define TIME_THRESHOLD_DEN  8
+
+/* Timer granularity, and the RTT assumed before the first sample, in
+ * nanoseconds. */
+#define GRANULARITY  1000000
+#define INITIAL_RTT  333000000
+
+/* Number of tail loss probes sent before declaring everything lost. */
+#define MAX_PROBES  2
+
+
+/* Static functions. */
+static struct twist__sent_packet * at(struct twist__sent * sent, uint64_t number);
+static int resize(struct twist__sent * sent, uint64_t size);
+static void acked(struct twist__sent * sent, uint64_t number, struct twist__sent_result * res);
+static void lost(struct twist__sent * sent, uint64_t number, struct twist__sent_result * res);
+static void settle(struct twist__sent * sent, struct twist__sent_packet * pkt);
+static void enqueue(struct twist__sent * sent, uint64_t number);
+static void detect(struct twist__sent * sent, int64_t now, struct twist__sent_result * res);
+static void advance(struct twist__sent * sent);
+static void sample(struct twist__sent * sent, int64_t rtt, int64_t delay);
+static int64_t loss_delay(struct twist__sent * sent);
+static int64_t probe_timeout(struct twist__sent * sent);
+
+
+/* Initialize the tracker. Returns TWIST_ENOMEM if a necessary allocation
+ * failed, otherwise TWIST_OK. */
+int twist__sent_init(struct twist__sent * sent, struct twist__mem * mem) {
+    struct twist__sent_packet * packets;
+
+    packets = twist__malloc(mem, MIN_SENT_SIZE * sizeof(struct twist__sent_packet));
+    if (packets == NULL)
+        return TWIST_ENOMEM;
+
+    sent->packets = packets;
+    sent->size = MIN_SENT_SIZE;
+    sent->head = 0;
+    sent->tail = 0;
+    sent->delivered = 0;
+    sent->inflight = 0;
+    sent->largest_acked = SENT_NONE;
+    sent->scan = 0;
+    sent->loss_time = 0;
+    sent->last_sent = 0;
+    sent->probes = 0;
+    sent->lost_head = SENT_NONE;
+    sent->lost_tail = SENT_NONE;
+    sent->latest_rtt = 0;
+    sent->srtt = 0;
+    sent->rttvar = 0;
+    sent->min_rtt = 0;
+    sent->mem = mem;
+
+    return TWIST_OK;
+}
+
+
+/* Free the tracker's ring. */
+void twist__sent_clear(struct twist__sent * sent) {
+    twist__free(sent->mem, sent->packets, (size_t) sent->size * sizeof(struct twist__sent_packet));
+}
+
+
+/* Record a packet carrying `len` bytes of stream data starting at `offset`. */
+int twist__sent_add(struct twist__sent * sent, uint64_t offset, size_t len,
+                    uint64_t orig, int64_t now, uint64_t * number) {
+    struct twist__sent_packet * pkt;
+    int ret;
+
+    /* Grow the ring if it's full. */
+    if (sent->tail - sent->head == sent->size) {
+        if (sent->size == MAX_SENT_SIZE)
+            return TWIST_ENOMEM;
+
+        ret = resize(sent, sent->size * 2);
+        if (ret != TWIST_OK)
+            return ret;
+    }
+
+    pkt = at(sent, sent->tail);
+    pkt->offset = offset;
+    pkt->len = len;
+    pkt->time = now;
+    pkt->link = orig;
+    pkt->flags = (orig != SENT_NONE ? SENT_RETX : 0);
+
+    sent->inflight += len;
+    sent->last_sent = now;
+
+    *number = sent->tail++;
+    return TWIST_OK;
+}
+
+
+/* Process an acknowledgement covering `count` ranges of packet numbers. */
+void twist__sent_on_ack(struct twist__sent * sent, const struct twist__range * ranges,
+                        size_t count, int64_t delay, int64_t now,
+                        struct twist__sent_result * res) {
+    uint64_t start, end, n, largest;
+    size_t i;
+
+    memset(res, 0, sizeof(*res));
+
+    /* Mark every newly acknowledged packet, keeping track of the largest. */
+    largest = SENT_NONE;
+
+    for (i = 0; i < count; i++) {
+        start = (ranges[i].start > sent->head ? ranges[i].start : sent->head);
+        end = (ranges[i].end < sent->tail ? ranges[i].end : sent->tail);
+
+        for (n = start; n < end; n++) {
+            if (at(sent, n)->flags & SENT_ACKED)
+                continue;
+
+            acked(sent, n, res);
+
+            if (largest == SENT_NONE || n > largest)
+                largest = n;
+        }
+    }
+
+    if (largest == SENT_NONE)
+        return;
+
+    /* Only an acknowledgement of a new largest packet yields an RTT sample,
+     * since the peer may have delayed acknowledging older packets. */
+    if (sent->largest_acked == SENT_NONE || largest > sent->largest_acked) {
+        sent->largest_acked = largest;
+
+        sample(sent, now - at(sent, largest)->time, delay);
+        res->rtt = sent->latest_rtt;
+    }
+
+    /* The peer is responsive, so stop backing off. */
+    sent->probes = 0;
+
+    detect(sent, now, res);
+    advance(sent);
+}
+
+
+/* Get the time at which `twist__sent_on_timeout` should be called next, or 0
+ * if there is nothing in flight. */
+int64_t twist__sent_timeout(struct twist__sent * sent) {
+    if (sent->loss_time != 0)
+        return sent->loss_time;
+
+    if (sent->inflight == 0)
+        return 0;
+
+    return sent->last_sent + probe_timeout(sent);
+}
+
+
+/* Process an expired RACK or probe timer. */
+void twist__sent_on_timeout(struct twist__sent * sent, int64_t now,
+                            struct twist__sent_result * res) {
+    uint64_t n;
+
+    memset(res, 0, sizeof(*res));
+
+    /* The RACK timer takes precedence. */
+    if (sent->loss_time != 0) {
+        if (now >= sent->loss_time) {
+            detect(sent, now, res);
+            advance(sent);
+        }
+
+        return;
+    }
+
+    if (sent->inflight == 0 || now < sent->last_sent + probe_timeout(sent))
+        return;
+
+    /* Send a tail loss probe, which either gets the tail of the window
+     * acknowledged or triggers loss detection for it. */
+    if (sent->probes < MAX_PROBES) {
+        sent->probes++;
+        res->probe = 1;
+        return;
+    }
+
+    /* Repeated probes went unanswered, so give up on everything in flight. The
+     * probe counter keeps growing, so the timeout keeps backing off until an
+     * acknowledgement arrives. */
+    for (n = sent->head; n < sent->tail; n++)
+        if ((at(sent, n)->flags & (SENT_ACKED | SENT_LOST)) == 0)
+            lost(sent, n, res);
+
+    sent->probes++;
+    res->rto = 1;
+
+    advance(sent);
+}
+
+
+/* Get the next packet whose data needs to be retransmitted, and remove it
+ * from the queue. Returns NULL if there is none. */
+const struct twist__sent_packet * twist__sent_next_lost(struct twist__sent * sent, uint64_t * number) {
+    struct twist__sent_packet * pkt;
+    int skipped;
+    uint64_t n;
+
+    skipped = 0;
+
+    while ((n = sent->lost_head) != SENT_NONE) {
+        pkt = at(sent, n);
+
+        sent->lost_head = pkt->link;
+        if (sent->lost_head == SENT_NONE)
+            sent->lost_tail = SENT_NONE;
+
+        pkt->link = SENT_NONE;
+        pkt->flags &= ~SENT_QUEUED;
+
+        /* The data may have been acknowledged after all, e.g. if the loss was
+         * spurious. */
+        if (pkt->flags & SENT_ACKED) {
+            skipped = 1;
+            continue;
+        }
+
+        break;
+    }
+
+    /* Acknowledged packets are only held back at `head` while they're queued,
+     * so once they're unlinked, `delivered` can catch up without waiting for
+     * the next acknowledgement. This never moves the records. */
+    if (skipped)
+        advance(sent);
+
+    if (n == SENT_NONE)
+        return NULL;
+
+    *number = n;
+    return pkt;
+}
+
+
+/* Get the newest packet still in flight, whose data a tail loss probe should
+ * carry if there's no new data to send. Returns NULL if there is none. */
+const struct twist__sent_packet * twist__sent_probe(struct twist__sent * sent, uint64_t * number) {
+    struct twist__sent_packet * pkt;
+    uint64_t n;
+
+    for (n = sent->tail; n > sent->head; n--) {
+        pkt = at(sent, n - 1);
+
+        if (pkt->flags & (SENT_ACKED | SENT_LOST))
+            continue;
+
+        /* Retransmissions are always made on behalf of the original, which
+         * may have been acknowledged in the meantime. */
+        if ((pkt->flags & SENT_RETX) == 0) {
+            *number = n - 1;
+            return pkt;
+        }
+
+        if (pkt->link >= sent->head && (at(sent, pkt->link)->flags & SENT_ACKED) == 0) {
+            *number = pkt->link;
+            return at(sent, pkt->link);
+        }
+    }
+
+    return NULL;
+}
+
+
+/* Get the record of a tracked packet. */
+static struct twist__sent_packet * at(struct twist__sent * sent, uint64_t number) {
+    return &sent->packets[number & (sent->size - 1)];
+}
+
+
+/* Move the ring to a larger storage array. Records are indexed by packet
+ * number, so they have to be redistributed rather than copied wholesale. */
+static int resize(struct twist__sent * sent, uint64_t size) {
+    struct twist__sent_packet * packets;
+    uint64_t n;
+
+    packets = twist__malloc(sent->mem, (size_t) size * sizeof(struct twist__sent_packet));
+    if (packets == NULL)
+        return TWIST_ENOMEM;
+
+    for (n = sent->head; n < sent->tail; n++)
+        packets[n & (size - 1)] = *at(sent, n);
+
+    twist__free(sent->mem, sent->packets, (size_t) sent->size * sizeof(struct twist__sent_packet));
+
+    sent->packets = packets;
+    sent->size = size;
+
+    return TWIST_OK;
+}
+
+
+/* Mark a packet as acknowledged. */
+static void acked(struct twist__sent * sent, uint64_t number, struct twist__sent_result * res) {
+    struct twist__sent_packet * pkt, * orig;
+
+    pkt = at(sent, number);
+    settle(sent, pkt);
+
+    /* A retransmission delivers its original packet's data too, unless the
+     * original (or another copy of it) got there first, in which case the
+     * bytes must not be counted twice. Originals which haven't been
+     * acknowledged are never behind `head`. */
+    if (pkt->flags & SENT_RETX) {
+        if (pkt->link < sent->head)
+            return;
+
+        orig = at(sent, pkt->link);
+        if (orig->flags & SENT_ACKED)
+            return;
+
+        settle(sent, orig);
+    }
+
+    res->acked += pkt->len;
+}
+
+
+/* Declare a packet lost, and queue its data for retransmission. */
+static void lost(struct twist__sent * sent, uint64_t number, struct twist__sent_result * res) {
+    struct twist__sent_packet * pkt, * orig;
+    uint64_t o;
+
+    pkt = at(sent, number);
+    pkt->flags |= SENT_LOST;
+
+    sent->inflight -= pkt->len;
+    res->lost += pkt->len;
+
+    if (pkt->time > res->lost_time)
+        res->lost_time = pkt->time;
+
+    /* The data is retransmitted on behalf of the original packet, unless it
+     * has been delivered or is already queued. A lost retransmission only
+     * requeues an original which was itself lost; a tail loss probe may have
+     * been sent while the original was still in flight, and the original is
+     * queued once it's declared lost in its own right. */
+    o = ((pkt->flags & SENT_RETX) ? pkt->link : number);
+    if (o < sent->head)
+        return;
+
+    orig = at(sent, o);
+    if (orig->flags & (SENT_ACKED | SENT_QUEUED))
+        return;
+
+    if (o == number || (orig->flags & SENT_LOST))
+        enqueue(sent, o);
+}
+
+
+/* Mark a packet as acknowledged, removing it from the bytes in flight unless
+ * that already happened when it was declared lost. */
+static void settle(struct twist__sent * sent, struct twist__sent_packet * pkt) {
+    if ((pkt->flags & SENT_LOST) == 0)
+        sent->inflight -= pkt->len;
+
+    pkt->flags |= SENT_ACKED;
+}
+
+
+/* Append an original packet to the retransmission queue. */
+static void enqueue(struct twist__sent * sent, uint64_t number) {
+    struct twist__sent_packet * pkt;
+
+    pkt = at(sent, number);
+    pkt->flags |= SENT_QUEUED;
+    pkt->link = SENT_NONE;
+
+    if (sent->lost_tail == SENT_NONE)
+        sent->lost_head = number;
+    else
+        at(sent, sent->lost_tail)->link = number;
+
+    sent->lost_tail = number;
+}
+
+
+/* Declare outstanding packets sent before the largest acknowledged one lost
+ * if they're far enough behind it, either by number or by time, and arm the
+ * RACK timer for the rest. */
+static void detect(struct twist__sent * sent, int64_t now, struct twist__sent_result * res) {
+    struct twist__sent_packet * pkt;
+    int64_t delay, deadline;
+    uint64_t n;
+
+    sent->loss_time = 0;
+
+    if (sent->largest_acked == SENT_NONE)
+        return;
+
+    delay = loss_delay(sent);
+
+    if (sent->scan < sent->head)
+        sent->scan = sent->head;
+
+    for (n = sent->scan; n < sent->largest_acked; n++) {
+        pkt = at(sent, n);
+
+        if ((pkt->flags & (SENT_ACKED | SENT_LOST)) == 0) {
+            deadline = pkt->time + delay;
+
+            if (sent->largest_acked - n >= PACKET_THRESHOLD || deadline <= now) {
+                lost(sent, n, res);
+            } else {
+                if (sent->loss_time == 0 || deadline < sent->loss_time)
+                    sent->loss_time = deadline;
+                continue;
+            }
+        }
+
+        /* Everything before `scan` has been settled one way or another. */
+        if (n == sent->scan)
+            sent->scan++;
+    }
+}
+
+
+/* Move `head` past packets which no longer need to be tracked, advancing the
+ * delivered stream offset along the way. */
+static void advance(struct twist__sent * sent) {
+    struct twist__sent_packet * pkt;
+
+    while (sent->head < sent->tail) {
+        pkt = at(sent, sent->head);
+
+        /* Acknowledged packets are done with, unless they're still linked
+         * into the retransmission queue. Lost retransmissions are done with
+         * too, since their original packets have either been queued again
+         * or are still being tracked in their own right. */
+        if ((pkt->flags & (SENT_ACKED | SENT_QUEUED)) != SENT_ACKED &&
+            (pkt->flags & (SENT_RETX | SENT_LOST)) != (SENT_RETX | SENT_LOST))
+            break;
+
+        if ((pkt->flags & SENT_RETX) == 0)
+            sent->delivered = pkt->offset + pkt->len;
+
+        sent->head++;
+    }
+}
+
+
+/* Update the RTT estimator with a new sample, from which the peer's reported
+ * acknowledgement delay is subtracted if that doesn't push it below the
+ * minimum. */
+static void sample(struct twist__sent * sent, int64_t rtt, int64_t delay) {
+    int64_t var;
+
+    if (rtt <= 0)
+        return;
+
+    sent->latest_rtt = rtt;
+
+    if (sent->min_rtt == 0 || rtt < sent->min_rtt)
+        sent->min_rtt = rtt;
+
+    if (delay > 0 && rtt - delay >= sent->min_rtt)
+        rtt -= delay;
+
+    if (sent->srtt == 0) {
+        sent->srtt = rtt;
+        sent->rttvar = rtt / 2;
+    } else {
+        var = (sent->srtt > rtt ? sent->srtt - rtt : rtt - sent->srtt);
+        sent->rttvar = (3 * sent->rttvar + var) / 4;
+        sent->srtt = (7 * sent->srtt + rtt) / 8;
+    }
+}
+
+
+/* Get the time after which a packet is declared lost if a later packet has
+ * been acknowledged. */
+static int64_t loss_delay(struct twist__sent * sent) {
+    int64_t rtt;
+
+    rtt = (sent->srtt != 0 ? sent->srtt : INITIAL_RTT);
+    if (sent->latest_rtt > rtt)
+        rtt = sent->latest_rtt;
+
+    rtt = rtt * TIME_THRESHOLD_NUM / TIME_THRESHOLD_DEN;
+    return (rtt > GRANULARITY ? rtt : GRANULARITY);
+}
+
+
+/* Get the probe timeout, backed off exponentially by the number of probes
+ * already sent. */
+static int64_t probe_timeout(struct twist__sent * sent) {
+    int64_t pto, var;
+
+    if (sent->srtt == 0) {
+        pto = 3 * INITIAL_RTT;
+    } else {
+        var = 4 * sent->rttvar;
+        pto = sent->srtt + (var > GRANULARITY ? var : GRANULARITY);
+    }
+
+    return pto << (sent->probes < 16 ? sent->probes : 16);
+}
@@ -0,0 +1,182 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#ifndef LIBTWIST_SENT_H
+#define LIBTWIST_SENT_H
+
+#include "include/twist.h"
+#include "src/mem.h"
+
+
+/* Sentinel packet number. */
+#define SENT_NONE  UINT64_MAX
+
+/* Flags describing the state of a sent packet. */
+#define SENT_ACKED   0x01
+#define SENT_LOST    0x02
+#define SENT_RETX    0x04
+#define SENT_QUEUED  0x08
+
+
+/* A range of packet numbers, from `start` up to but not including `end`, as
+ * carried by selective acknowledgements. */
+struct twist__range {
+    uint64_t start;
+    uint64_t end;
+};
+
+
+/* Record of a packet carrying stream data. The data itself isn't copied; it
+ * stays in the connection's write buffer until it has been acknowledged, and
+ * is located there by its stream offset when it needs to be retransmitted. */
+struct twist__sent_packet {
+    /* Stream offset and length of the data. */
+    uint64_t offset;
+    size_t len;
+
+    /* Time the packet was sent. */
+    int64_t time;
+
+    /* For retransmissions (SENT_RETX), the number of the packet that first
+     * carried the data. For original packets queued for retransmission
+     * (SENT_QUEUED), the number of the next packet in the queue. */
+    uint64_t link;
+
+    /* SENT_* flags. */
+    unsigned int flags;
+};
+
+
+/* Outcome of processing an acknowledgement or a timeout. */
+struct twist__sent_result {
+    /* Bytes newly acknowledged, and newly declared lost. */
+    size_t acked;
+    size_t lost;
+
+    /* Send time of the last packet declared lost, or 0 if none were. */
+    int64_t lost_time;
+
+    /* New RTT sample, or 0 if there is none. */
+    int64_t rtt;
+
+    /* Set if the probe timeout fired, and a probe packet should be sent
+     * (TLP), or if all outstanding data was declared lost after repeated
+     * probes went unanswered (RTO). */
+    int probe;
+    int rto;
+};
+
+
+/* The `twist__sent` struct tracks a connection's packets from the time they
+ * are sent until they're acknowledged or declared lost, using RACK-TLP (RFC
+ * 8985) for loss detection: packets are declared lost when a packet sent
+ * sufficiently later has been acknowledged, or once a timer derived from the
+ * RTT expires, rather than after a full retransmission timeout. Packets are
+ * numbered consecutively and stored in a ring indexed by number, so looking
+ * one up takes constant time. Retransmissions get new packet numbers, which
+ * avoids any ambiguity in RTT samples. */
+struct twist__sent {
+    /* Ring of packet records, its size (a power of two), and the numbers of
+     * the oldest tracked packet and of the next packet to be sent. */
+    struct twist__sent_packet * packets;
+    uint64_t size;
+    uint64_t head;
+    uint64_t tail;
+
+    /* Stream offset up to which all data has been acknowledged, i.e. how much
+     * of the write buffer may be discarded. */
+    uint64_t delivered;
+
+    /* Bytes in flight (sent, but neither acknowledged nor lost). */
+    size_t inflight;
+
+    /* Largest packet number acknowledged. Packet numbers are assigned in
+     * send order, so this is also the most recently sent packet known to
+     * have been delivered. */
+    uint64_t largest_acked;
+
+    /* First packet number which hasn't been acknowledged or declared lost,
+     * where loss detection starts scanning. */
+    uint64_t scan;
+
+    /* Time at which the earliest outstanding packet will be declared lost by
+     * the RACK timer, or 0 if none will. */
+    int64_t loss_time;
+
+    /* Time the last packet was sent, and the number of consecutive probe
+     * timeouts. */
+    int64_t last_sent;
+    unsigned int probes;
+
+    /* Queue of original packets whose data needs to be retransmitted,
+     * linked through their `link` fields. */
+    uint64_t lost_head;
+    uint64_t lost_tail;
+
+    /* RTT estimator (RFC 6298): latest sample, smoothed RTT, RTT variation
+     * and minimum RTT. All are 0 until the first sample. */
+    int64_t latest_rtt;
+    int64_t srtt;
+    int64_t rttvar;
+    int64_t min_rtt;
+
+    /* Memory context. */
+    struct twist__mem * mem;
+};
+
+
+/* Initialize the tracker. Returns TWIST_ENOMEM if a necessary allocation
+ * failed, otherwise TWIST_OK. */
+int twist__sent_init(struct twist__sent * sent, struct twist__mem * mem);
+
+/* Free the tracker's ring. */
+void twist__sent_clear(struct twist__sent * sent);
+
+
+/* Record a packet carrying `len` bytes of stream data starting at `offset`.
+ * For retransmissions, `orig` is the number of the packet returned by
+ * `twist__sent_next_lost`; otherwise it's SENT_NONE. The packet's number is
+ * stored in `number`. Returns TWIST_ENOMEM if the ring had to grow and the
+ * allocation failed. */
+int twist__sent_add(struct twist__sent * sent, uint64_t offset, size_t len,
+                    uint64_t orig, int64_t now, uint64_t * number);
+
+/* Process an acknowledgement covering `count` ranges of packet numbers, which
+ * the peer held on to for `delay` nanoseconds before sending it. Ranges below
+ * the oldest tracked packet and beyond the newest are ignored. */
+void twist__sent_on_ack(struct twist__sent * sent, const struct twist__range * ranges,
+                        size_t count, int64_t delay, int64_t now,
+                        struct twist__sent_result * res);
+
+/* Get the time at which `twist__sent_on_timeout` should be called next, or 0
+ * if there is nothing in flight. */
+int64_t twist__sent_timeout(struct twist__sent * sent);
+
+/* Process an expired RACK or probe timer. */
+void twist__sent_on_timeout(struct twist__sent * sent, int64_t now,
+                            struct twist__sent_result * res);
+
+/* Get the next packet whose data needs to be retransmitted, and remove it
+ * from the queue. Returns NULL if there is none. The returned pointer is only
+ * valid until the next call to `twist__sent_add`. */
+const struct twist__sent_packet * twist__sent_next_lost(struct twist__sent * sent, uint64_t * number);
+
+
+/* Get the newest packet still in flight, whose data a tail loss probe should
+ * carry if there's no new data to send, and the number to pass as `orig`
+ * when sending it. Returns NULL if there is none. */
+const struct twist__sent_packet * twist__sent_probe(struct twist__sent * sent, uint64_t * number);
+
+
+#endif
@@ -12,12 +12,17 @@
  * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
  * PERFORMANCE OF THIS SOFTWARE. */
 
+#include <limits.h>
+
 #include <nectar.h>
 
+#include "src/ack.h"
 #include "src/endian.h"
 #include "src/env.h"
 #include "src/mem.h"
+#include "src/pacer.h"
 #include "src/sock.h"
+#include "src/window.h"
 
 
 /* This static array helps generate Poly1305 MACs for control packets sent
@@ -30,7 +35,18 @@ static const uint8_t zero[32] = {
 };
 
 
+/* Maximum number of packets passed to a single `send_packets` call. */
+#define SEND_BATCH_SIZE  64
+
+/* Default high water mark for connections' send buffers. */
+#define DEFAULT_SEND_HIGH  (1024 * 1024)
+
+
 /* Static functions. */
+static int finish(struct twist__sock * sock, int64_t now);
+static int flush(struct twist__sock * sock);
+static int flush_ring(struct twist__sock * sock);
+static void unready(struct twist__sock * sock, struct twist__conn * conn);
 static int handle_tick(struct twist__sock * sock, int64_t now);
 static int handle_recv(struct twist__sock * sock,
                        const struct sockaddr * addr, socklen_t addrlen,
@@ -48,32 +64,98 @@ static int64_t check_ticket(struct twist__sock * sock, const uint8_t src[64],
 static int generate_cookie(struct twist__sock * sock, uint64_t * cookie);
 
 
-/* Allocate and initialize a new socket. */
-int twist__sock_create(struct twist__sock ** sockptr, struct twist__env * env) {
+/* Allocate and initialize a new socket. The `opts` argument may be NULL, in
+ * which case default options are used. */
+int twist__sock_create(struct twist__sock ** sockptr, struct twist__env * env,
+                       const struct twist_opts * opts) {
+    static const struct twist_opts defaults;
     struct twist__sock * sock;
+    struct twist__mem mem;
     uint8_t seed[16];
     int ret;
 
-    /* Allocate the socket struct itself. */
-    sock = twist__malloc(sizeof(*sock));
+    /* Validate the options. */
+    if (opts == NULL)
+        opts = &defaults;
+
+    if (opts->timers != TWIST_TIMERS_HEAP && opts->timers != TWIST_TIMERS_WHEEL) {
+        ret = TWIST_EINVAL;
+        goto err0;
+    }
+
+    if (opts->hash != TWIST_HASH_FAST && opts->hash != TWIST_HASH_SIPHASH) {
+        ret = TWIST_EINVAL;
+        goto err0;
+    }
+
+    if (opts->cc != TWIST_CC_CUBIC && opts->cc != TWIST_CC_RENO && opts->cc != TWIST_CC_BBR) {
+        ret = TWIST_EINVAL;
+        goto err0;
+    }
+
+    if (opts->pacing_burst > PACER_MAX_BURST) {
+        ret = TWIST_EINVAL;
+        goto err0;
+    }
+
+    if (opts->ack_frequency > ACK_MAX_THRESHOLD || opts->ack_delay < 0 ||
+        opts->ack_delay > ACK_MAX_DELAY) {
+        ret = TWIST_EINVAL;
+        goto err0;
+    }
+
+    if (opts->pool_window < 0 || (opts->pool_max != 0 && opts->pool_max < opts->pool_min)) {
+        ret = TWIST_EINVAL;
+        goto err0;
+    }
+
+    if ((opts->recv_window != 0 && opts->recv_window < WINDOW_MIN_SIZE) ||
+        (opts->recv_window_max != 0 && opts->recv_window_max <
+         (opts->recv_window != 0 ? opts->recv_window : WINDOW_DEFAULT_SIZE))) {
+        ret = TWIST_EINVAL;
+        goto err0;
+    }
+
+    if (opts->send_low > (opts->send_high != 0 ? opts->send_high : DEFAULT_SEND_HIGH)) {
+        ret = TWIST_EINVAL;
+        goto err0;
+    }
+
+    if (opts->allocator != NULL && (opts->allocator->alloc == NULL ||
+                                    opts->allocator->resize == NULL ||
+                                    opts->allocator->release == NULL)) {
+        ret = TWIST_EINVAL;
+        goto err0;
+    }
+
+    /* Allocate the socket struct itself, then move the memory context into
+     * it so the other internal structs can refer to it. */
+    twist__mem_init(&mem, opts->allocator, opts->mem_budget);
+
+    sock = twist__malloc(&mem, sizeof(*sock));
     if (sock == NULL) {
         ret = TWIST_ENOMEM;
         goto err0;
     }
 
+    sock->mem = mem;
+
     /* Move `env` into the socket. */
     memcpy(&sock->env, env, sizeof(*env));
 
     /* Initialize the PRNG. */
-    ret = twist__prng_init(&sock->prng, &sock->env);
+    ret = twist__prng_init(&sock->prng, &sock->env, &sock->mem);
     if (ret != TWIST_OK)
         goto err1;
 
     /* Initialize the packet pool. */
-    twist__pool_init(&sock->pool);
+    twist__pool_init(&sock->pool, &sock->mem);
+    twist__pool_retain(&sock->pool, opts->pool_min,
+                       (opts->pool_max != 0 ? opts->pool_max : UINT_MAX),
+                       (opts->pool_window != 0 ? opts->pool_window : POOL_DEFAULT_WINDOW));
 
     /* Initialize the token register. */
-    ret = twist__register_init(&sock->reg, 60);
+    ret = twist__register_init(&sock->reg, 60, &sock->mem);
     if (ret != TWIST_OK)
         goto err2;
 
@@ -82,12 +164,12 @@ int twist__sock_create(struct twist__sock ** sockptr, struct twist__env * env) {
     if (ret != TWIST_OK)
         goto err3;
 
-    ret = twist__dict_init(&sock->dict, seed);
+    ret = twist__dict_init(&sock->dict, seed, opts->hash, &sock->mem);
     if (ret != TWIST_OK)
         goto err3;
 
-    /* Initialize the connection min-heap. */
-    ret = twist__heap_init(&sock->heap);
+    /* Initialize the connection timers. */
+    ret = twist__timers_init(&sock->timers, opts->timers, &sock->mem);
     if (ret != TWIST_OK)
         goto err4;
 
@@ -96,11 +178,39 @@ int twist__sock_create(struct twist__sock ** sockptr, struct twist__env * env) {
     if (ret != TWIST_OK)
         goto err5;
 
+    /* The pool grows a whole chunk at a time, so a budget without room for
+     * one next to the tables above could never fit a single packet. */
+    if (sock->mem.budget - sock->mem.used < POOL_CHUNK_SIZE) {
+        ret = TWIST_EINVAL;
+        goto err5;
+    }
+
     /* Set all other internal fields. */
     sock->last_tick = 0;
     sock->next_tick = 0;
+    sock->outgoing = NULL;
+    sock->outgoing_tail = &sock->outgoing;
     sock->lingering = NULL;
+    sock->ingress = NULL;
+    sock->egress = NULL;
     sock->accepted = NULL;
+    sock->ready = NULL;
+    sock->events = 0;
+    sock->shard = 0;
+    sock->shard_bits = 0;
+    sock->cc = opts->cc;
+    sock->pacing_burst = (opts->pacing_burst != 0 ? opts->pacing_burst : PACER_DEFAULT_BURST);
+    sock->ack_frequency = (opts->ack_frequency != 0 ? opts->ack_frequency : ACK_DEFAULT_THRESHOLD);
+    sock->ack_delay = (opts->ack_delay != 0 ? opts->ack_delay : ACK_DEFAULT_DELAY);
+    sock->recv_window = (opts->recv_window != 0 ? opts->recv_window : WINDOW_DEFAULT_SIZE);
+    sock->recv_window_max = (opts->recv_window_max != 0 ? opts->recv_window_max : WINDOW_DEFAULT_MAX);
+
+    /* A large initial window without an explicit maximum raises the default
+     * maximum, rather than leaving the window above its own limit. */
+    if (sock->recv_window_max < sock->recv_window)
+        sock->recv_window_max = sock->recv_window;
+    sock->send_high = (opts->send_high != 0 ? opts->send_high : DEFAULT_SEND_HIGH);
+    sock->send_low = (opts->send_low != 0 ? opts->send_low : sock->send_high / 4);
 
     /* Finally, update `sockptr` and exit. */
     *sockptr = sock;
@@ -108,7 +218,7 @@ int twist__sock_create(struct twist__sock ** sockptr, struct twist__env * env) {
 
     /* Error handling. */
 err5:
-    twist__heap_clear(&sock->heap);
+    twist__timers_clear(&sock->timers);
 err4:
     twist__dict_clear(&sock->dict);
 err3:
@@ -117,7 +227,7 @@ err2:
     twist__pool_clear(&sock->pool);
     twist__prng_clear(&sock->prng);
 err1:
-    twist__free(sock);
+    twist__free(&mem, sock, sizeof(*sock));
 err0:
     *sockptr = NULL;
     return ret;
@@ -129,12 +239,14 @@ err0:
 int twist__sock_destroy(struct twist__sock ** sockptr) {
     struct twist__sock * sock;
     struct twist__conn * conn;
+    struct twist__packet * pkt;
+    struct twist__mem mem;
 
     /* Dereference the pointer. */
     sock = *sockptr;
 
     /* Abort if there still are open connections. */
-    if (twist__heap_peek(&sock->heap) != NULL)
+    if (!twist__timers_empty(&sock->timers))
         return TWIST_EAGAIN;
 
     /* Drop any connections that have been accepted by the socket, but not
@@ -144,15 +256,32 @@ int twist__sock_destroy(struct twist__sock ** sockptr) {
         twist__conn_destroy(&conn);
     }
 
+    /* Release packets kept around since the last operation, which have to be
+     * returned to the pool before its chunks can be freed. */
+    while ((pkt = sock->lingering) != NULL) {
+        sock->lingering = pkt->next;
+        twist__packet_free(&sock->pool, pkt);
+    }
+
     /* Tear down all internal structs. */
-    twist__heap_clear(&sock->heap);
+    twist__timers_clear(&sock->timers);
     twist__dict_clear(&sock->dict);
     twist__register_clear(&sock->reg);
     twist__pool_clear(&sock->pool);
     twist__prng_clear(&sock->prng);
 
-    /* Free the socket and clear `sockptr`. */
-    twist__free(sock);
+    /* Free the rings, if any. */
+    if (sock->ingress != NULL) {
+        twist__ring_clear(sock->ingress);
+        twist__ring_clear(sock->egress);
+        twist__free(&sock->mem, sock->ingress, sizeof(struct twist__ring));
+        twist__free(&sock->mem, sock->egress, sizeof(struct twist__ring));
+    }
+
+    /* Free the socket and clear `sockptr`. The memory context has to be
+     * copied out first, since it lives inside the socket. */
+    mem = sock->mem;
+    twist__free(&mem, sock, sizeof(*sock));
     *sockptr = NULL;
 
     return TWIST_OK;
@@ -163,10 +292,10 @@ int twist__sock_destroy(struct twist__sock ** sockptr) {
 int twist__sock_add(struct twist__sock * sock, struct twist__conn * conn) {
     int ret;
 
-    /* Add the connection to the socket's hash table and heap. The order we
+    /* Add the connection to the socket's hash table and timers. The order we
      * do this in is deliberate because, in the case of a failure, removing a
      * connection from the dict is more costly than removing it from a heap. */
-    ret = twist__heap_add(&sock->heap, conn);
+    ret = twist__timers_add(&sock->timers, conn);
     if (ret != TWIST_OK)
         goto err0;
 
@@ -179,7 +308,7 @@ int twist__sock_add(struct twist__sock * sock, struct twist__conn * conn) {
 
     /* Something went wrong. */
 err1:
-    twist__heap_remove(&sock->heap, conn);
+    twist__timers_remove(&sock->timers, conn);
 err0:
     return ret;
 }
@@ -188,7 +317,7 @@ err0:
 /* Remove a connection from the socket's internal data structures. */
 void twist__sock_remove(struct twist__sock * sock, struct twist__conn * conn) {
     twist__dict_remove(&sock->dict, conn);
-    twist__heap_remove(&sock->heap, conn);
+    twist__timers_remove(&sock->timers, conn);
 
     /* If the connection is being stored in the socket's `accepted`
      * list, unlink it. */
@@ -201,33 +330,94 @@ void twist__sock_remove(struct twist__sock * sock, struct twist__conn * conn) {
         conn->prev->next = conn->next;
         conn->next->prev = conn->prev;
     }
+
+    /* The same goes for the list of connections with pending events. */
+    if (conn->events != 0)
+        unready(sock, conn);
+}
+
+
+/* Record readiness events for a connection, and queue it for the next call
+ * to `twist__sock_poll` unless it's already queued. */
+void twist__sock_notify(struct twist__sock * sock, struct twist__conn * conn, unsigned int events) {
+    struct twist__conn * head;
+
+    if (events == 0)
+        return;
+
+    /* Connections with pending events are already in the list. */
+    if (conn->events != 0) {
+        conn->events |= events;
+        return;
+    }
+
+    conn->events = events;
+
+    /* Append the connection, so events are reported in the order in which
+     * connections first became ready. */
+    if ((head = sock->ready) == NULL) {
+        conn->ready_prev = conn;
+        conn->ready_next = conn;
+        sock->ready = conn;
+    } else {
+        conn->ready_next = head;
+        conn->ready_prev = head->ready_prev;
+        conn->ready_prev->ready_next = conn;
+        conn->ready_next->ready_prev = conn;
+    }
+}
+
+
+/* Fill in up to `max` events for the connections (and the socket) with
+ * pending readiness events, and return the number of events filled in. */
+int twist__sock_poll(struct twist__sock * sock, struct twist_event * events, int max) {
+    struct twist__conn * conn;
+    int n = 0;
+
+    /* Socket-wide events come first. */
+    if (n < max && sock->events != 0) {
+        events[n].conn = NULL;
+        events[n].events = sock->events;
+        sock->events = 0;
+        n++;
+    }
+
+    while (n < max && (conn = sock->ready) != NULL) {
+        events[n].conn = (struct twist_conn *) conn;
+        events[n].events = conn->events;
+        n++;
+
+        unready(sock, conn);
+    }
+
+    return n;
+}
+
+
+/* Queue a packet for transmission at the end of the current socket operation.
+ * The socket takes ownership of `pkt`, which must have been allocated from the
+ * socket's object pool using `twist__packet_alloc`. */
+void twist__sock_send(struct twist__sock * sock, struct twist__packet * pkt) {
+    pkt->next = NULL;
+
+    *sock->outgoing_tail = pkt;
+    sock->outgoing_tail = &pkt->next;
 }
 
 
 /* Feed a clock tick to the socket. */
 int twist__sock_tick(struct twist__sock * sock, int64_t now) {
-    struct twist__conn * conn;
-    int ret;
+    int ret, err;
 
     /* Let the `tick` function do its job. It was separated out because while
      * the function for receiving packets also needs to process ticks, we don't
-     * want to cull the object pool twice. */
+     * want to trim the object pool twice. */
     ret = handle_tick(sock, now);
 
-    /* Cull excess objects from the object pool, regardless of whether the
-     * `handle_tick` call was successful.
-     *
-     * TODO: Give the user an opportunity to specify how many objects to keep
-     *       in the pool. Eight feels like a reasonable number for now. */
-    twist__pool_cull(&sock->pool, 8);
-
-    /* Update `sock->next_tick`. */
-    conn = twist__heap_peek(&sock->heap);
-    if (conn != NULL) {
-        sock->next_tick = conn->next_tick;
-    } else {
-        sock->next_tick = 0;
-    }
+    /* Clean up, regardless of whether the `handle_tick` call was successful. */
+    err = finish(sock, now);
+    if (ret == TWIST_OK)
+        ret = err;
 
     return ret;
 }
@@ -237,8 +427,7 @@ int twist__sock_tick(struct twist__sock * sock, int64_t now) {
 int twist__sock_recv(struct twist__sock * sock,
                      const struct sockaddr * addr, socklen_t addrlen,
                      const uint8_t * payload, size_t len, int64_t now) {
-    struct twist__conn * conn;
-    int ret;
+    int ret, err;
 
     /* Trigger all pending connection timers first. Only if that operation
      * succeeds do we actually process the packet. */
@@ -246,25 +435,320 @@ int twist__sock_recv(struct twist__sock * sock,
     if (ret >= 0)
         ret = handle_recv(sock, addr, addrlen, payload, len, now);
 
-    /* Cull excess objects from the object pool, regardless of whether the
-     * `handle_tick` and `handle_recv` calls were successful.
-     *
-     * TODO: Give the user an opportunity to specify how many objects to keep
-     *       in the pool. Eight feels like a reasonable number for now. */
-    twist__pool_cull(&sock->pool, 8);
+    /* Clean up, regardless of whether the `handle_tick` and `handle_recv`
+     * calls were successful. */
+    err = finish(sock, now);
+    if (ret == TWIST_OK)
+        ret = err;
+
+    return ret;
+}
+
+
+/* Feed a batch of incoming packets to the socket. Pending timers are only
+ * triggered once, before any of the packets are processed, and the outcome of
+ * each individual packet is stored in its `status` field. */
+int twist__sock_recv_many(struct twist__sock * sock,
+                          struct twist_datagram * dgrams, size_t count, int64_t now) {
+    size_t i;
+    int ret, err;
+
+    /* All packets in the batch share the same timestamp, so we only need to
+     * trigger pending connection timers once. If that fails, none of the
+     * packets are processed. */
+    ret = handle_tick(sock, now);
+
+    for (i = 0; i < count; i++) {
+        if (ret >= 0) {
+            dgrams[i].status = handle_recv(sock, dgrams[i].addr, dgrams[i].addrlen,
+                                           dgrams[i].buf, dgrams[i].len, now);
+        } else {
+            dgrams[i].status = ret;
+        }
+    }
+
+    /* Clean up once for the whole batch. */
+    err = finish(sock, now);
+    if (ret == TWIST_OK)
+        ret = err;
+
+    return ret;
+}
+
+
+/* Get a snapshot of the socket's memory usage. */
+void twist__sock_stats(struct twist__sock * sock, struct twist_sock_stats * stats) {
+    stats->memory = sock->mem.used;
+    stats->budget = (sock->mem.budget != SIZE_MAX ? sock->mem.budget : 0);
+    stats->pool_reserved = twist__pool_reserved(&sock->pool);
+    stats->pool_used = twist__pool_used(&sock->pool);
+    stats->tables = twist__dict_memory(&sock->dict) + twist__timers_memory(&sock->timers);
+    stats->connections = (size_t) sock->dict.count;
+}
+
+
+/* Attach a pair of ingress/egress rings, each with room for `size` packets,
+ * to the socket. This must be done before any other thread starts using
+ * the rings. */
+int twist__sock_attach(struct twist__sock * sock, size_t size) {
+    struct twist__ring * ingress, * egress;
+    int ret;
+
+    /* Rings can only be attached once. */
+    if (sock->ingress != NULL) {
+        ret = TWIST_EINVAL;
+        goto err0;
+    }
+
+    ingress = twist__malloc(&sock->mem, sizeof(*ingress));
+    if (ingress == NULL) {
+        ret = TWIST_ENOMEM;
+        goto err0;
+    }
+
+    egress = twist__malloc(&sock->mem, sizeof(*egress));
+    if (egress == NULL) {
+        ret = TWIST_ENOMEM;
+        goto err1;
+    }
+
+    ret = twist__ring_init(ingress, size, &sock->mem);
+    if (ret != TWIST_OK)
+        goto err2;
+
+    ret = twist__ring_init(egress, size, &sock->mem);
+    if (ret != TWIST_OK)
+        goto err3;
+
+    sock->ingress = ingress;
+    sock->egress = egress;
+
+    return TWIST_OK;
+
+    /* Error handling. */
+err3:
+    twist__ring_clear(ingress);
+err2:
+    twist__free(&sock->mem, egress, sizeof(*egress));
+err1:
+    twist__free(&sock->mem, ingress, sizeof(*ingress));
+err0:
+    return ret;
+}
+
+
+/* Process all packets currently waiting in the ingress ring. Pending timers
+ * are only triggered once, as with `twist__sock_recv_many`. */
+int twist__sock_drain(struct twist__sock * sock, int64_t now) {
+    struct twist__packet * pkt;
+    uint64_t n;
+    int ret, err;
+
+    if (sock->ingress == NULL)
+        return TWIST_EINVAL;
+
+    /* If triggering the pending timers fails, the packets are left in the
+     * ring for the next call. */
+    ret = handle_tick(sock, now);
+    if (ret < 0)
+        goto out;
+
+    /* Don't process more than one ring's worth of packets per call, or a
+     * sufficiently fast I/O thread could keep us here forever. */
+    for (n = 0; n <= sock->ingress->mask; n++) {
+        pkt = twist__ring_peek(sock->ingress);
+        if (pkt == NULL)
+            break;
+
+        /* Unlike `twist__sock_recv_many`, there is nowhere to report the
+         * outcome of individual packets, so the first error is returned
+         * once the ring has been drained. */
+        err = handle_recv(sock, (const struct sockaddr *) &pkt->addr, (socklen_t) pkt->addr.len,
+                          pkt->payload, pkt->len, now);
+        if (ret == TWIST_OK)
+            ret = err;
+
+        twist__ring_release(sock->ingress);
+    }
+
+    /* Clean up once for the whole batch. */
+out:
+    err = finish(sock, now);
+    if (ret == TWIST_OK)
+        ret = err;
+
+    return ret;
+}
+
+
+/* I/O thread: copy a received datagram onto the ingress ring. Fails with
+ * TWIST_EAGAIN if the ring is full. */
+int twist__sock_ingress_push(struct twist__sock * sock,
+                             const struct sockaddr * addr, socklen_t addrlen,
+                             const uint8_t * payload, size_t len) {
+    struct twist__packet * pkt;
+
+    if (sock->ingress == NULL || len > RING_MAX_PAYLOAD || addrlen > MAX_ADDR_LEN)
+        return TWIST_EINVAL;
+
+    pkt = twist__ring_reserve(sock->ingress);
+    if (pkt == NULL)
+        return TWIST_EAGAIN;
+
+    twist__packet_init(pkt, addr, addrlen, payload, len);
+    twist__ring_publish(sock->ingress);
+
+    return TWIST_OK;
+}
+
+
+/* I/O thread: get the oldest packet waiting in the egress ring. Fails with
+ * TWIST_EAGAIN if the ring is empty. The datagram remains valid until
+ * `twist__sock_egress_release` is called. */
+int twist__sock_egress_peek(struct twist__sock * sock, struct twist_datagram * dgram) {
+    struct twist__packet * pkt;
+
+    if (sock->egress == NULL)
+        return TWIST_EINVAL;
+
+    pkt = twist__ring_peek(sock->egress);
+    if (pkt == NULL)
+        return TWIST_EAGAIN;
+
+    dgram->addr = (const struct sockaddr *) &pkt->addr;
+    dgram->addrlen = (socklen_t) pkt->addr.len;
+    dgram->buf = pkt->payload;
+    dgram->len = pkt->len;
+    dgram->status = TWIST_OK;
+
+    return TWIST_OK;
+}
+
+
+/* I/O thread: discard the packet returned by `twist__sock_egress_peek`. */
+void twist__sock_egress_release(struct twist__sock * sock) {
+    twist__ring_release(sock->egress);
+}
+
+
+/* Perform the housekeeping required at the end of every public socket
+ * operation. Returns TWIST_ETRANS if sending any queued packet failed,
+ * otherwise TWIST_OK. */
+static int finish(struct twist__sock * sock, int64_t now) {
+    int ret;
+
+    /* Send everything queued during this operation. */
+    ret = flush(sock);
+
+    /* Release memory the pool hasn't needed in a while. */
+    twist__pool_trim(&sock->pool, now);
 
     /* Update `sock->next_tick`. */
-    conn = twist__heap_peek(&sock->heap);
-    if (conn != NULL) {
-        sock->next_tick = conn->next_tick;
-    } else {
-        sock->next_tick = 0;
+    sock->next_tick = twist__timers_next(&sock->timers);
+
+    return ret;
+}
+
+
+/* Hand all queued outgoing packets over to the environment. Sent packets are
+ * moved to the `lingering` list, where they'll stay until the next operation
+ * on the socket. */
+static int flush(struct twist__sock * sock) {
+    const struct twist__packet * batch[SEND_BATCH_SIZE];
+    struct twist__packet * pkt;
+    size_t n;
+    int ret;
+
+    /* With an egress ring attached, packets go to the I/O thread instead. */
+    if (sock->egress != NULL)
+        return flush_ring(sock);
+
+    ret = TWIST_OK;
+
+    while (sock->outgoing != NULL) {
+        /* Collect the next batch of packets. */
+        for (n = 0; n < SEND_BATCH_SIZE && sock->outgoing != NULL; n++) {
+            pkt = sock->outgoing;
+            sock->outgoing = pkt->next;
+
+            pkt->next = sock->lingering;
+            sock->lingering = pkt;
+
+            batch[n] = pkt;
+        }
+
+        /* Keep going after a failure; every packet should get its chance. */
+        if (twist__env_send_many(&sock->env, batch, n) != TWIST_OK)
+            ret = TWIST_ETRANS;
+    }
+
+    sock->outgoing_tail = &sock->outgoing;
+
+    return ret;
+}
+
+
+/* Copy all queued outgoing packets onto the egress ring. Since the copies
+ * are owned by the ring, the originals are recycled immediately. Packets that
+ * don't fit, either because the ring is full or because they're larger than a
+ * ring slot, are dropped and reported as a TWIST_ETRANS failure. */
+static int flush_ring(struct twist__sock * sock) {
+    struct twist__packet * pkt, * slot;
+    int ret;
+
+    ret = TWIST_OK;
+
+    while (sock->outgoing != NULL) {
+        pkt = sock->outgoing;
+        sock->outgoing = pkt->next;
+
+        /* Packets can come from any of the pool's size classes, but a ring
+         * slot only holds a datagram sized one. */
+        if (pkt->len > RING_MAX_PAYLOAD) {
+            ret = TWIST_ETRANS;
+            twist__packet_free(&sock->pool, pkt);
+            continue;
+        }
+
+        slot = twist__ring_reserve(sock->egress);
+        if (slot != NULL) {
+            twist__addr_copy(&slot->addr, &pkt->addr);
+            memcpy(slot->payload, pkt->payload, pkt->len);
+            slot->len = pkt->len;
+
+            twist__ring_publish(sock->egress);
+        } else {
+            ret = TWIST_ETRANS;
+        }
+
+        twist__packet_free(&sock->pool, pkt);
     }
 
+    sock->outgoing_tail = &sock->outgoing;
+
     return ret;
 }
 
 
+/* Unlink a connection from the list of connections with pending events, and
+ * clear its events. */
+static void unready(struct twist__sock * sock, struct twist__conn * conn) {
+    if (conn->ready_next == conn) {
+        sock->ready = NULL;
+    } else {
+        if (sock->ready == conn)
+            sock->ready = conn->ready_next;
+
+        conn->ready_prev->ready_next = conn->ready_next;
+        conn->ready_next->ready_prev = conn->ready_prev;
+    }
+
+    conn->events = 0;
+    conn->ready_prev = NULL;
+    conn->ready_next = NULL;
+}
+
+
 /* Feed a clock tick to the socket (inner). */
 static int handle_tick(struct twist__sock * sock, int64_t now) {
     struct twist__packet * pkt;
@@ -276,7 +760,7 @@ static int handle_tick(struct twist__sock * sock, int64_t now) {
         pkt = sock->lingering;
         sock->lingering = pkt->next;
 
-        twist__pool_free(&sock->pool, pkt);
+        twist__packet_free(&sock->pool, pkt);
     }
 
     /* Time travel is strictly forbidden. */
@@ -288,32 +772,21 @@ static int handle_tick(struct twist__sock * sock, int64_t now) {
     if (now < sock->next_tick || sock->next_tick <= 0)
         goto discard;
 
-    /* Propagate this tick to all relevant connections. */
-    for (;;) {
-        conn = twist__heap_peek(&sock->heap);
-
-        /* The heap is only empty when there aren't any open connections on the
-         * socket, which means there can't be any pending timers. */
-        if (conn == NULL) {
-            sock->next_tick = 0;
-            break;
-        }
-
-        /* If the next timer isn't due to expire yet, stop. */
-        if (conn->next_tick > now) {
-            sock->next_tick = conn->next_tick;
-            break;
-        }
+    /* Propagate this tick to all connections whose timers have expired. */
+    twist__timers_advance(&sock->timers, now);
 
+    while ((conn = twist__timers_expire(&sock->timers, now)) != NULL) {
         /* Forward the tick to the next connection. */
         ret = twist__conn_tick(conn, now);
         if (ret != TWIST_OK)
             return ret;
 
-        /* Update `conn`'s position in the heap. */
-        twist__heap_fix(&sock->heap, conn);
+        /* Update `conn`'s position among the socket's timers. */
+        twist__timers_fix(&sock->timers, conn);
     }
 
+    sock->next_tick = twist__timers_next(&sock->timers);
+
     /* Everything went fine - store this tick. */
     sock->last_tick = now;
 
@@ -327,7 +800,7 @@ static int handle_recv(struct twist__sock * sock,
                        const struct sockaddr * addr, socklen_t addrlen,
                        const uint8_t * payload, size_t len, int64_t now) {
     struct twist__conn * conn;
-    struct twist__packet * pkt;
+    struct twist__packet pkt;
     char type;
     uint64_t cookie;
     int ret;
@@ -370,21 +843,18 @@ static int handle_recv(struct twist__sock * sock,
     if (conn == NULL)
         goto discard;
 
-    /* Construct a proper packet object that we can hand over to the
-     * connection state machine. */
-    pkt = twist__pool_alloc(&sock->pool);
-    if (pkt == NULL)
-        return TWIST_ENOMEM;
-
-    twist__packet_init(pkt, addr, addrlen, payload, len);
+    /* Wrap the payload in a packet object that we can hand over to the
+     * connection state machine. The payload isn't copied; it's up to the
+     * connection to copy whatever it needs to keep. */
+    twist__packet_wrap(&pkt, addr, addrlen, payload, len);
 
     /* Pass the packet on to the receiving connection's handle. */
-    ret = twist__conn_recv(conn, type, pkt, now);
+    ret = twist__conn_recv(conn, type, &pkt, now);
     if (ret != TWIST_OK)
         return ret;
 
-    /* Update `conn`'s position in the heap. */
-    twist__heap_fix(&sock->heap, conn);
+    /* Update `conn`'s position among the socket's timers. */
+    twist__timers_fix(&sock->timers, conn);
 
 discard:
     return TWIST_OK;
@@ -419,6 +889,12 @@ static int handle_connect(struct twist__sock * sock,
     if (nectar_bcmp(payload + 160, mac, 16) != 0)
         goto discard;
 
+    /* Shed load by ignoring new connections while the socket is short on
+     * memory. The client will retransmit its handshake, and may well succeed
+     * once existing connections have drained their buffers. */
+    if (twist__mem_pressure(&sock->mem))
+        goto discard;
+
     /* Make sure that the attached handshake ticket is valid. */
     tokid = check_ticket(sock, payload + 96, addr, addrlen, now);
     if (tokid < 0) {
@@ -456,6 +932,7 @@ static int handle_connect(struct twist__sock * sock,
     }
 
     sock->accepted = conn;
+    sock->events |= TWIST_ACCEPTABLE;
 
     /* We don't invalidate the ticket's token until we know every other
      * operation was successful - otherwise it'd be impossible to retry calls
@@ -549,6 +1026,13 @@ static int generate_cookie(struct twist__sock * sock, uint64_t * dst) {
         ret = twist__prng_read(&sock->prng, (uint8_t *) &cookie, sizeof(cookie));
         if (ret != TWIST_OK)
             return ret;
+
+        /* Shards in a socket group encode their index in the cookie, which
+         * lets incoming packets be routed without any shared state. */
+        if (sock->shard_bits > 0) {
+            cookie >>= sock->shard_bits;
+            cookie |= ((uint64_t) sock->shard) << (64 - sock->shard_bits);
+        }
     } while (cookie == 0 || twist__dict_find(&sock->dict, cookie) != NULL);
 
     *dst = cookie;
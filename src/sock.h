@@ -18,10 +18,12 @@
 #include "include/twist.h"
 #include "src/dict.h"
 #include "src/env.h"
-#include "src/heap.h"
+#include "src/mem.h"
 #include "src/pool.h"
 #include "src/prng.h"
 #include "src/register.h"
+#include "src/ring.h"
+#include "src/timers.h"
 
 
 /* Socket state. */
@@ -31,16 +33,28 @@ struct twist__sock {
     int64_t last_tick;
 
     /* This field holds the next clock tick which will affect a connection's
-     * state. Essentially a shortcut for `twist__heap_peek(heap)->next_tick`. */
+     * state. Essentially a shortcut for `twist__timers_next(timers)`. */
     int64_t next_tick;
 
+    /* Queue of outgoing packets, which are handed to the environment in
+     * batches at the end of each socket operation. */
+    struct twist__packet * outgoing;
+    struct twist__packet ** outgoing_tail;
+
     /* Singly-linked list of packets that need to be kept around for a bit
      * because of our guarantee that everything passed to a `send_packet`
      * function will be valid until the next operation on the socket. */
     struct twist__packet * lingering;
 
+    /* Optional pair of rings used to exchange packets with a dedicated I/O
+     * thread. When attached, outgoing packets are pushed onto `egress` rather
+     * than handed to the environment, and incoming packets are read from
+     * `ingress` by `twist__sock_drain`. Both are NULL unless attached. */
+    struct twist__ring * ingress;
+    struct twist__ring * egress;
+
     /* Connections ordered by their `next_tick` values. */
-    struct twist__heap heap;
+    struct twist__timers timers;
 
     /* Hash table of connections keyed by their local cookies. */
     struct twist__dict dict;
@@ -48,9 +62,39 @@ struct twist__sock {
     /* Circular linked list of accepted connections. */
     struct twist__conn * accepted;
 
-    /* Key used when encrypting and signing handshake tickets. */
+    /* Circular linked list of connections with pending readiness events,
+     * oldest first, and socket-wide events (TWIST_ACCEPTABLE) not yet
+     * reported by `twist__sock_poll`. */
+    struct twist__conn * ready;
+    unsigned int events;
+
+    /* Key used when encrypting and signing handshake tickets. Shared by all
+     * shards in a socket group. */
     uint8_t ticket_key[32];
 
+    /* When the socket is a shard in a socket group, its index is encoded in
+     * the `shard_bits` most significant bits of every local cookie it
+     * generates. Both fields are zero for stand-alone sockets. */
+    uint32_t shard;
+    unsigned int shard_bits;
+
+    /* Congestion control algorithm and pacing burst allowance for new
+     * connections. */
+    int cc;
+    size_t pacing_burst;
+
+    /* Acknowledgement frequency for new connections. */
+    unsigned int ack_frequency;
+    int64_t ack_delay;
+
+    /* Initial and maximum receive window sizes for new connections. */
+    size_t recv_window;
+    size_t recv_window_max;
+
+    /* Send buffer water marks for new connections. */
+    size_t send_high;
+    size_t send_low;
+
     /* Strike-register for handshake tickets. */
     struct twist__register reg;
 
@@ -62,11 +106,17 @@ struct twist__sock {
 
     /* Environment. */
     struct twist__env env;
+
+    /* Memory context used for all of the socket's allocations, including
+     * the socket struct itself. */
+    struct twist__mem mem;
 };
 
 
-/* Allocate and initialize a new socket. */
-int twist__sock_create(struct twist__sock ** sockptr, struct twist__env * env);
+/* Allocate and initialize a new socket. The `opts` argument may be NULL, in
+ * which case default options are used. */
+int twist__sock_create(struct twist__sock ** sockptr, struct twist__env * env,
+                       const struct twist_opts * opts);
 
 /* Free a socket. Fails with TWIST_EAGAIN if the socket in question has any
  * open (as in not yet dropped) connections. */
@@ -80,6 +130,21 @@ int twist__sock_add(struct twist__sock * sock, struct twist__conn * conn);
 void twist__sock_remove(struct twist__sock * sock, struct twist__conn * conn);
 
 
+/* Queue a packet for transmission at the end of the current socket operation.
+ * The socket takes ownership of `pkt`, which must have been allocated from the
+ * socket's object pool using `twist__packet_alloc`. */
+void twist__sock_send(struct twist__sock * sock, struct twist__packet * pkt);
+
+
+/* Record readiness events for a connection, and queue it for the next call
+ * to `twist__sock_poll` unless it's already queued. */
+void twist__sock_notify(struct twist__sock * sock, struct twist__conn * conn, unsigned int events);
+
+/* Fill in up to `max` events for the connections (and the socket) with
+ * pending readiness events, and return the number of events filled in. */
+int twist__sock_poll(struct twist__sock * sock, struct twist_event * events, int max);
+
+
 /* Feed a clock tick to the socket. */
 int twist__sock_tick(struct twist__sock * sock, int64_t now);
 
@@ -88,6 +153,40 @@ int twist__sock_recv(struct twist__sock * sock,
                      const struct sockaddr * addr, socklen_t addrlen,
                      const uint8_t * payload, size_t len, int64_t now);
 
+/* Feed a batch of incoming packets to the socket. Pending timers are only
+ * triggered once, before any of the packets are processed, and the outcome of
+ * each individual packet is stored in its `status` field. */
+int twist__sock_recv_many(struct twist__sock * sock,
+                          struct twist_datagram * dgrams, size_t count, int64_t now);
+
+
+/* Get a snapshot of the socket's memory usage. */
+void twist__sock_stats(struct twist__sock * sock, struct twist_sock_stats * stats);
+
+
+/* Attach a pair of ingress/egress rings, each with room for `size` packets,
+ * to the socket. This must be done before any other thread starts using
+ * the rings. */
+int twist__sock_attach(struct twist__sock * sock, size_t size);
+
+/* Process all packets currently waiting in the ingress ring. Pending timers
+ * are only triggered once, as with `twist__sock_recv_many`. */
+int twist__sock_drain(struct twist__sock * sock, int64_t now);
+
+
+/* I/O thread: copy a received datagram onto the ingress ring. Fails with
+ * TWIST_EAGAIN if the ring is full. */
+int twist__sock_ingress_push(struct twist__sock * sock,
+                             const struct sockaddr * addr, socklen_t addrlen,
+                             const uint8_t * payload, size_t len);
+
+/* I/O thread: get the oldest packet waiting in the egress ring. Fails with
+ * TWIST_EAGAIN if the ring is empty. The datagram remains valid until
+ * `twist__sock_egress_release` is called. */
+int twist__sock_egress_peek(struct twist__sock * sock, struct twist_datagram * dgram);
+
+/* I/O thread: discard the packet returned by `twist__sock_egress_peek`. */
+void twist__sock_egress_release(struct twist__sock * sock);
 
 
 #endif
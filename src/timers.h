@@ -0,0 +1,148 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#ifndef LIBTWIST_TIMERS_H
+#define LIBTWIST_TIMERS_H
+
+#include "include/twist.h"
+#include "src/heap.h"
+#include "src/wheel.h"
+
+
+/* The `twist__timers` struct stores a socket's connections ordered by their
+ * `next_tick` values, using either a min-heap or a timing wheel as selected
+ * when the socket was created. */
+struct twist__timers {
+    /* Either TWIST_TIMERS_HEAP or TWIST_TIMERS_WHEEL. */
+    int type;
+
+    /* The underlying implementation. */
+    union {
+        struct twist__heap heap;
+        struct twist__wheel wheel;
+    } u;
+};
+
+
+/* Initialize the timer structure. Returns TWIST_ENOMEM if a necessary
+ * allocation failed, otherwise TWIST_OK. */
+static inline int twist__timers_init(struct twist__timers * timers, int type,
+                                     struct twist__mem * mem) {
+    timers->type = type;
+
+    if (type == TWIST_TIMERS_WHEEL)
+        return twist__wheel_init(&timers->u.wheel);
+    else
+        return twist__heap_init(&timers->u.heap, mem);
+}
+
+
+/* Free the timer structure's underlying storage. */
+static inline void twist__timers_clear(struct twist__timers * timers) {
+    if (timers->type == TWIST_TIMERS_WHEEL)
+        twist__wheel_clear(&timers->u.wheel);
+    else
+        twist__heap_clear(&timers->u.heap);
+}
+
+
+/* Bring the timers up to date with the socket's clock. This is a no-op for
+ * the heap, which doesn't have a notion of time. */
+static inline void twist__timers_advance(struct twist__timers * timers, int64_t now) {
+    if (timers->type == TWIST_TIMERS_WHEEL)
+        twist__wheel_advance(&timers->u.wheel, now);
+}
+
+
+/* Get a connection whose timer has expired at `now`, or NULL if there isn't
+ * one. The timers must have been advanced to `now` first. */
+static inline struct twist__conn * twist__timers_expire(struct twist__timers * timers, int64_t now) {
+    struct twist__conn * conn;
+
+    if (timers->type == TWIST_TIMERS_WHEEL)
+        return twist__wheel_expire(&timers->u.wheel, now);
+
+    conn = twist__heap_peek(&timers->u.heap);
+    if (conn == NULL || conn->next_tick <= 0 || conn->next_tick > now)
+        return NULL;
+
+    return conn;
+}
+
+
+/* Get the time at which the next timer expires, or zero if there aren't any
+ * pending timers. The timing wheel may report a slightly earlier time for
+ * distant timers, which only costs a spurious wakeup. */
+static inline int64_t twist__timers_next(struct twist__timers * timers) {
+    struct twist__conn * conn;
+
+    if (timers->type == TWIST_TIMERS_WHEEL)
+        return twist__wheel_next(&timers->u.wheel);
+
+    conn = twist__heap_peek(&timers->u.heap);
+    if (conn == NULL || conn->next_tick <= 0)
+        return 0;
+
+    return conn->next_tick;
+}
+
+
+/* Returns a non-zero value if there aren't any connections. */
+static inline int twist__timers_empty(struct twist__timers * timers) {
+    if (timers->type == TWIST_TIMERS_WHEEL)
+        return twist__wheel_empty(&timers->u.wheel);
+    else
+        return (twist__heap_peek(&timers->u.heap) == NULL);
+}
+
+
+/* Add a connection. */
+static inline int twist__timers_add(struct twist__timers * timers, struct twist__conn * conn) {
+    if (timers->type == TWIST_TIMERS_WHEEL)
+        return twist__wheel_add(&timers->u.wheel, conn);
+    else
+        return twist__heap_add(&timers->u.heap, conn);
+}
+
+
+/* Remove a connection. */
+static inline void twist__timers_remove(struct twist__timers * timers, struct twist__conn * conn) {
+    if (timers->type == TWIST_TIMERS_WHEEL)
+        twist__wheel_remove(&timers->u.wheel, conn);
+    else
+        twist__heap_remove(&timers->u.heap, conn);
+}
+
+
+/* Re-establish ordering after a particular connection's `next_tick` value
+ * has changed. */
+static inline void twist__timers_fix(struct twist__timers * timers, struct twist__conn * conn) {
+    if (timers->type == TWIST_TIMERS_WHEEL)
+        twist__wheel_fix(&timers->u.wheel, conn);
+    else
+        twist__heap_fix(&timers->u.heap, conn);
+}
+
+
+/* Get the number of bytes allocated by the timers; the timing wheel is
+ * embedded in the socket and never allocates anything. */
+static inline size_t twist__timers_memory(const struct twist__timers * timers) {
+    if (timers->type == TWIST_TIMERS_WHEEL)
+        return 0;
+    else
+        return twist__heap_memory(&timers->u.heap);
+}
+
+
+#endif
@@ -0,0 +1,290 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include <string.h>
+
+#include "src/conn.h"
+#include "src/wheel.h"
+
+
+/* Value of `conn->wheel_slot` for connections stored in the idle list. */
+#define IDLE_SLOT  0xffffffff
+
+
+/* Static functions. */
+static void insert(struct twist__wheel * wheel, struct twist__conn * conn);
+static void detach(struct twist__wheel * wheel, struct twist__conn * conn);
+static unsigned int lowest(uint64_t x);
+static unsigned int highest(uint64_t x);
+
+
+/* Initialize the timing wheel. Always returns TWIST_OK. */
+int twist__wheel_init(struct twist__wheel * wheel) {
+    memset(wheel, 0, sizeof(*wheel));
+    return TWIST_OK;
+}
+
+
+/* Release any resources held by the timing wheel. */
+void twist__wheel_clear(struct twist__wheel * wheel) {
+    /* The wheel doesn't own any memory, but we keep this function around
+     * for symmetry with `twist__heap_clear`. */
+    (void) wheel;
+}
+
+
+/* Move the wheel's current position forward to `now`. Connections in slots
+ * which have been passed are moved to the current level 0 slot, and those in
+ * slots which have been entered are redistributed over the levels below. */
+void twist__wheel_advance(struct twist__wheel * wheel, int64_t now) {
+    struct twist__conn * conn, * next, * pending;
+    unsigned int level, index, shift;
+    uint64_t target, mask, slots;
+
+    if (now <= 0)
+        return;
+
+    target = ((uint64_t) now) >> WHEEL_SHIFT;
+    if (target <= wheel->current)
+        return;
+
+    /* Collect the connections that have to move. If the new position shares
+     * all bits above a level with the old one, only the slots up to and
+     * including the new position's slot are affected; otherwise everything
+     * on that level is now due. */
+    pending = NULL;
+
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        shift = (level + 1) * WHEEL_BITS;
+
+        if ((wheel->current >> shift) == (target >> shift)) {
+            index = (unsigned int) (target >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1);
+            mask = (index == WHEEL_SLOTS - 1 ? ~((uint64_t) 0) : (((uint64_t) 1) << (index + 1)) - 1);
+        } else {
+            mask = ~((uint64_t) 0);
+        }
+
+        slots = wheel->occupied[level] & mask;
+        wheel->occupied[level] &= ~mask;
+
+        while (slots != 0) {
+            index = lowest(slots);
+            slots &= slots - 1;
+
+            for (conn = wheel->slots[level][index]; conn != NULL; conn = next) {
+                next = conn->wheel_next;
+                conn->wheel_next = pending;
+                pending = conn;
+            }
+
+            wheel->slots[level][index] = NULL;
+        }
+    }
+
+    /* Re-insert them relative to the new position. */
+    wheel->current = target;
+
+    for (conn = pending; conn != NULL; conn = next) {
+        next = conn->wheel_next;
+        insert(wheel, conn);
+    }
+}
+
+
+/* Get a connection whose timer has expired at `now`, or NULL if there isn't
+ * one. The wheel must have been advanced to `now` first. Expired connections
+ * are returned in no particular order. */
+struct twist__conn * twist__wheel_expire(struct twist__wheel * wheel, int64_t now) {
+    struct twist__conn * conn;
+
+    /* After advancing, every expired timer is in the first level 0 slot. */
+    if (wheel->occupied[0] == 0)
+        return NULL;
+
+    for (conn = wheel->slots[0][lowest(wheel->occupied[0])]; conn != NULL; conn = conn->wheel_next)
+        if (conn->next_tick <= now)
+            return conn;
+
+    return NULL;
+}
+
+
+/* Get the time at which the next timer expires, or zero if there aren't any
+ * pending timers. Timers more than one level 0 revolution ahead of the wheel's
+ * current position are reported as the start of their slot, which is never
+ * later than the actual deadline. */
+int64_t twist__wheel_next(const struct twist__wheel * wheel) {
+    struct twist__conn * conn;
+    unsigned int level, index, shift;
+    int64_t min;
+    uint64_t tick;
+
+    /* Level 0 slots are narrow enough to be scanned in their entirety. */
+    if (wheel->occupied[0] != 0) {
+        conn = wheel->slots[0][lowest(wheel->occupied[0])];
+        min = conn->next_tick;
+
+        for (conn = conn->wheel_next; conn != NULL; conn = conn->wheel_next)
+            if (conn->next_tick < min)
+                min = conn->next_tick;
+
+        return min;
+    }
+
+    /* Otherwise use the start of the first occupied slot on the lowest
+     * occupied level. */
+    for (level = 1; level < WHEEL_LEVELS; level++) {
+        if (wheel->occupied[level] != 0) {
+            index = lowest(wheel->occupied[level]);
+            shift = level * WHEEL_BITS;
+
+            tick = (wheel->current >> (shift + WHEEL_BITS)) << (shift + WHEEL_BITS);
+            tick |= ((uint64_t) index) << shift;
+
+            return (int64_t) (tick << WHEEL_SHIFT);
+        }
+    }
+
+    return 0;
+}
+
+
+/* Returns a non-zero value if the wheel doesn't contain any connections. */
+int twist__wheel_empty(const struct twist__wheel * wheel) {
+    unsigned int level;
+
+    for (level = 0; level < WHEEL_LEVELS; level++)
+        if (wheel->occupied[level] != 0)
+            return 0;
+
+    return (wheel->idle == NULL);
+}
+
+
+/* Add a connection to the wheel. Always returns TWIST_OK. */
+int twist__wheel_add(struct twist__wheel * wheel, struct twist__conn * conn) {
+    insert(wheel, conn);
+    return TWIST_OK;
+}
+
+
+/* Remove a connection from the wheel. */
+void twist__wheel_remove(struct twist__wheel * wheel, struct twist__conn * conn) {
+    detach(wheel, conn);
+}
+
+
+/* Move a connection to the correct slot after its `next_tick` value
+ * has changed. */
+void twist__wheel_fix(struct twist__wheel * wheel, struct twist__conn * conn) {
+    detach(wheel, conn);
+    insert(wheel, conn);
+}
+
+
+/* Link a connection into the slot matching its `next_tick` value. */
+static void insert(struct twist__wheel * wheel, struct twist__conn * conn) {
+    struct twist__conn ** head;
+    unsigned int level, index;
+    uint64_t tick, diff;
+
+    if (conn->next_tick <= 0) {
+        head = &wheel->idle;
+        conn->wheel_slot = IDLE_SLOT;
+    } else {
+        /* Timers in the past are treated as if they were due at the wheel's
+         * current position, which puts them in the first level 0 slot. */
+        tick = ((uint64_t) conn->next_tick) >> WHEEL_SHIFT;
+        if (tick < wheel->current)
+            tick = wheel->current;
+
+        /* The level is determined by the most significant bit in which the
+         * tick differs from the wheel's current position. */
+        diff = tick ^ wheel->current;
+        level = (diff != 0 ? highest(diff) / WHEEL_BITS : 0);
+        index = (unsigned int) (tick >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1);
+
+        head = &wheel->slots[level][index];
+        conn->wheel_slot = (uint32_t) (level * WHEEL_SLOTS + index);
+
+        wheel->occupied[level] |= ((uint64_t) 1) << index;
+    }
+
+    /* Prepend the connection to the slot's list. */
+    conn->wheel_prev = NULL;
+    conn->wheel_next = *head;
+
+    if (*head != NULL)
+        (*head)->wheel_prev = conn;
+
+    *head = conn;
+}
+
+
+/* Unlink a connection from its current slot. */
+static void detach(struct twist__wheel * wheel, struct twist__conn * conn) {
+    unsigned int level, index;
+
+    if (conn->wheel_next != NULL)
+        conn->wheel_next->wheel_prev = conn->wheel_prev;
+
+    if (conn->wheel_prev != NULL) {
+        conn->wheel_prev->wheel_next = conn->wheel_next;
+    } else if (conn->wheel_slot == IDLE_SLOT) {
+        wheel->idle = conn->wheel_next;
+    } else {
+        level = conn->wheel_slot / WHEEL_SLOTS;
+        index = conn->wheel_slot % WHEEL_SLOTS;
+
+        /* If this was the only connection in the slot, mark it as empty. */
+        wheel->slots[level][index] = conn->wheel_next;
+        if (conn->wheel_next == NULL)
+            wheel->occupied[level] &= ~(((uint64_t) 1) << index);
+    }
+
+    conn->wheel_prev = NULL;
+    conn->wheel_next = NULL;
+}
+
+
+/* Find the index of the least significant set bit in a non-zero integer. */
+static unsigned int lowest(uint64_t x) {
+#if defined(__GNUC__)
+    return (unsigned int) __builtin_ctzll(x);
+#else
+    unsigned int n = 0;
+
+    while ((x & 1) == 0) {
+        x >>= 1;
+        n++;
+    }
+
+    return n;
+#endif
+}
+
+
+/* Find the index of the most significant set bit in a non-zero integer. */
+static unsigned int highest(uint64_t x) {
+#if defined(__GNUC__)
+    return 63 - (unsigned int) __builtin_clzll(x);
+#else
+    unsigned int n = 0;
+
+    while (x >>= 1)
+        n++;
+
+    return n;
+#endif
+}
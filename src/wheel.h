@@ -0,0 +1,88 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#ifndef LIBTWIST_WHEEL_H
+#define LIBTWIST_WHEEL_H
+
+#include "include/twist.h"
+
+
+/* Wheel geometry. Ticks are mapped onto slots after discarding their lowest
+ * WHEEL_SHIFT bits, and each of the WHEEL_LEVELS levels consumes WHEEL_BITS
+ * bits of what remains, which is enough to cover every positive `int64_t`. */
+#define WHEEL_SHIFT   12
+#define WHEEL_BITS    6
+#define WHEEL_SLOTS   (1 << WHEEL_BITS)
+#define WHEEL_LEVELS  9
+
+
+/* The `twist__wheel` struct is a hierarchical timing wheel which stores
+ * connections ordered by their `next_tick` values. It implements the same
+ * set of operations as `twist__heap`, but adding, removing and rescheduling
+ * a connection are all constant time operations; the cost is instead paid
+ * (amortized) when cascading connections from coarser to finer levels.
+ *
+ * The wheel's position follows the socket's clock through
+ * `twist__wheel_advance`, so timers keep their own level 0 slots (each
+ * covering a 4096 ns window) no matter how far away the latest timer is. */
+struct twist__wheel {
+    /* Doubly-linked lists of connections, one for each slot on each level. */
+    struct twist__conn * slots[WHEEL_LEVELS][WHEEL_SLOTS];
+
+    /* Bitmaps indicating which slots are non-empty. */
+    uint64_t occupied[WHEEL_LEVELS];
+
+    /* Connections which don't have a pending timer (i.e. whose `next_tick`
+     * values are zero or negative). */
+    struct twist__conn * idle;
+
+    /* The wheel's current position, in units of 2^WHEEL_SHIFT ns. */
+    uint64_t current;
+};
+
+
+/* Initialize the timing wheel. Always returns TWIST_OK. */
+int twist__wheel_init(struct twist__wheel * wheel);
+
+/* Release any resources held by the timing wheel. */
+void twist__wheel_clear(struct twist__wheel * wheel);
+
+
+/* Move the wheel's current position forward to `now`. */
+void twist__wheel_advance(struct twist__wheel * wheel, int64_t now);
+
+/* Get a connection whose timer has expired at `now`, or NULL if there isn't
+ * one. The wheel must have been advanced to `now` first. */
+struct twist__conn * twist__wheel_expire(struct twist__wheel * wheel, int64_t now);
+
+/* Get the time at which the next timer expires, or zero if there aren't any
+ * pending timers. Distant timers are reported as the start of their slot. */
+int64_t twist__wheel_next(const struct twist__wheel * wheel);
+
+/* Returns a non-zero value if the wheel doesn't contain any connections. */
+int twist__wheel_empty(const struct twist__wheel * wheel);
+
+/* Add a connection to the wheel. Always returns TWIST_OK. */
+int twist__wheel_add(struct twist__wheel * wheel, struct twist__conn * conn);
+
+/* Remove a connection from the wheel. */
+void twist__wheel_remove(struct twist__wheel * wheel, struct twist__conn * conn);
+
+
+/* Move a connection to the correct slot after its `next_tick` value
+ * has changed. */
+void twist__wheel_fix(struct twist__wheel * wheel, struct twist__conn * conn);
+
+
+#endif
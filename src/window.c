@@ -0,0 +1,153 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#include "src/window.h"
+
+
+/* Static functions. */
+static uint64_t target(struct twist__window * win, struct twist__buffer * bufr,
+                       const struct twist__mem * mem);
+
+
+/* Initialize the flow control state with an initial receive window of `size`
+ * bytes, which may grow up to `max` bytes. */
+void twist__window_init(struct twist__window * win, size_t size, size_t max) {
+    win->recv_end = 0;
+    win->recv_size = size;
+    win->recv_max = max;
+    win->recv_consumed = 0;
+    win->recv_mark = 0;
+    win->recv_epoch = 0;
+
+    /* Until windows have been exchanged, both ends assume the minimum. */
+    win->recv_limit = WINDOW_MIN_SIZE;
+    win->send_limit = WINDOW_MIN_SIZE;
+}
+
+
+/* Account for received data ending at stream offset `end`. Returns TWIST_EINVAL
+ * if the data exceeds the advertised limit. */
+int twist__window_recv(struct twist__window * win, uint64_t end) {
+    if (end > win->recv_limit)
+        return TWIST_EINVAL;
+
+    if (end > win->recv_end)
+        win->recv_end = end;
+
+    return TWIST_OK;
+}
+
+
+/* Account for `len` bytes of data having been consumed by the application,
+ * and grow the receive window if needed. */
+void twist__window_consume(struct twist__window * win, size_t len, int64_t rtt, int64_t now) {
+    uint64_t drained;
+
+    win->recv_consumed += len;
+
+    /* Without an RTT sample, there's nothing to measure the drain rate
+     * against. */
+    if (rtt <= 0)
+        return;
+
+    if (win->recv_epoch == 0) {
+        win->recv_epoch = now;
+        return;
+    }
+
+    if (now - win->recv_epoch < rtt)
+        return;
+
+    /* If the application drained more than half a window during the last
+     * round trip, the window may be what's holding the sender back, so give
+     * it room to double its rate. The window never shrinks again; memory
+     * pressure is handled when advertising instead. */
+    drained = win->recv_consumed - win->recv_mark;
+
+    if (drained > win->recv_size / 2) {
+        if (drained > win->recv_max / 2)
+            win->recv_size = win->recv_max;
+        else if (2 * drained > win->recv_size)
+            win->recv_size = (size_t) (2 * drained);
+    }
+
+    /* Start a new measurement period. */
+    win->recv_mark = win->recv_consumed;
+    win->recv_epoch = now;
+}
+
+
+/* Get the limit to advertise to the peer. */
+uint64_t twist__window_advertise(struct twist__window * win, struct twist__buffer * bufr,
+                                 const struct twist__mem * mem) {
+    uint64_t limit;
+
+    limit = target(win, bufr, mem);
+    if (limit > win->recv_limit)
+        win->recv_limit = limit;
+
+    return win->recv_limit;
+}
+
+
+/* Returns a non-zero value if a window update should be sent. */
+int twist__window_stale(struct twist__window * win, struct twist__buffer * bufr,
+                        const struct twist__mem * mem) {
+    uint64_t limit;
+
+    /* Updates are only worth sending once the window has opened up by at
+     * least a quarter, which keeps their number proportional to the amount
+     * of data transferred. */
+    limit = target(win, bufr, mem);
+    return (limit > win->recv_limit && limit - win->recv_limit >= win->recv_size / 4);
+}
+
+
+/* Account for a limit advertised by the peer. */
+void twist__window_update(struct twist__window * win, uint64_t limit) {
+    if (limit > win->send_limit)
+        win->send_limit = limit;
+}
+
+
+/* Get the number of bytes that may be sent, starting at stream offset
+ * `offset`, without exceeding the peer's window. */
+size_t twist__window_sendable(struct twist__window * win, uint64_t offset) {
+    uint64_t avail;
+
+    if (offset >= win->send_limit)
+        return 0;
+
+    avail = win->send_limit - offset;
+    return (avail < SIZE_MAX ? (size_t) avail : SIZE_MAX);
+}
+
+
+/* Compute the limit the receive window currently allows: the end of the
+ * received data, plus whatever part of the window isn't already occupied by
+ * buffered data. */
+static uint64_t target(struct twist__window * win, struct twist__buffer * bufr,
+                       const struct twist__mem * mem) {
+    size_t size, buffered;
+
+    size = win->recv_size;
+    if (twist__mem_pressure(mem) && size > WINDOW_MIN_SIZE)
+        size = WINDOW_MIN_SIZE;
+
+    buffered = twist__buffer_size(bufr);
+    if (buffered >= size)
+        return win->recv_end;
+
+    return win->recv_end + (size - buffered);
+}
@@ -0,0 +1,99 @@
+/* Copyright (c) 2015, Erik Lundin.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE
+ * OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. */
+
+#ifndef LIBTWIST_WINDOW_H
+#define LIBTWIST_WINDOW_H
+
+#include "include/twist.h"
+#include "src/buffer.h"
+#include "src/mem.h"
+
+
+/* Smallest receive window a connection may use. Both ends assume the peer's
+ * window is this large until it has advertised a limit of its own. */
+#define WINDOW_MIN_SIZE      16384
+
+/* Default initial and maximum receive window sizes. */
+#define WINDOW_DEFAULT_SIZE  65536
+#define WINDOW_DEFAULT_MAX   (4 * 1024 * 1024)
+
+
+/* Per-connection flow control state. Limits are absolute stream offsets, so
+ * window updates are idempotent and may safely be reordered or duplicated.
+ *
+ * The receive window is sized after the occupancy of the connection's read
+ * buffer, and grows towards `recv_max` as the application proves it's able
+ * to drain it: like Linux's receive buffer autotuning, the window is set to
+ * twice the amount of data consumed during the last round trip, so that it
+ * never becomes the bottleneck for a sender limited only by the network. */
+struct twist__window {
+    /* One past the highest stream offset received so far. */
+    uint64_t recv_end;
+
+    /* Highest limit advertised to the peer. Advertised limits never move
+     * backwards, even when the window shrinks. */
+    uint64_t recv_limit;
+
+    /* Current receive window size, and the cap it's autotuned towards. */
+    size_t recv_size;
+    size_t recv_max;
+
+    /* Total number of bytes consumed by the application, and the value it had
+     * at the start of the current measurement period, along with the time
+     * that period started. */
+    uint64_t recv_consumed;
+    uint64_t recv_mark;
+    int64_t recv_epoch;
+
+    /* Highest limit advertised by the peer. */
+    uint64_t send_limit;
+};
+
+
+/* Initialize the flow control state with an initial receive window of `size`
+ * bytes, which may grow up to `max` bytes. */
+void twist__window_init(struct twist__window * win, size_t size, size_t max);
+
+
+/* Account for received data ending at stream offset `end`. Returns TWIST_EINVAL
+ * if the data exceeds the advertised limit, in which case the peer is
+ * misbehaving and the data must be discarded. */
+int twist__window_recv(struct twist__window * win, uint64_t end);
+
+/* Account for `len` bytes of data having been consumed by the application,
+ * given the connection's current smoothed round-trip time (or 0 if unknown),
+ * and grow the receive window if needed. */
+void twist__window_consume(struct twist__window * win, size_t len, int64_t rtt, int64_t now);
+
+/* Get the limit to advertise to the peer, given the data currently waiting in
+ * the connection's read buffer. While the socket is under memory pressure,
+ * the window is clamped to WINDOW_MIN_SIZE. */
+uint64_t twist__window_advertise(struct twist__window * win, struct twist__buffer * bufr,
+                                 const struct twist__mem * mem);
+
+/* Returns a non-zero value if the window has opened up far enough beyond the
+ * last advertised limit that a window update should be sent. */
+int twist__window_stale(struct twist__window * win, struct twist__buffer * bufr,
+                        const struct twist__mem * mem);
+
+
+/* Account for a limit advertised by the peer. */
+void twist__window_update(struct twist__window * win, uint64_t limit);
+
+/* Get the number of bytes that may be sent, starting at stream offset
+ * `offset`, without exceeding the peer's window. */
+size_t twist__window_sendable(struct twist__window * win, uint64_t offset);
+
+
+#endif